@@ -69,8 +69,11 @@ def clean(dirs):
     tryRemove(dirs.make, "*.d")
     tryRemove(dirs.obj, "*.o")
     tryRemove(dirs.obj, "*.a")
+    tryRemove(dirs.obj, "*.stamp")
     tryRemove(dirs.inc, "baby*.hpp")
     tryRemove(dirs.src, "baby*.cpp")
+    tryRemove(dirs.src, "compiled_functions.cpp")
+    tryRemove(os.path.join(dirs.obj, "jit"), None)
     tryRemove(".", ".subdirs.mk")
     pass
 
@@ -0,0 +1,51 @@
+#ifndef H_BULK_BRANCH
+#define H_BULK_BRANCH
+
+#include <cstddef>
+#include <cstring>
+
+#include <memory>
+
+class TBranch;
+class TBufferFile;
+
+class BulkBranch{
+public:
+  BulkBranch();
+  BulkBranch(const BulkBranch &) = delete;
+  BulkBranch & operator=(const BulkBranch &) = delete;
+  BulkBranch(BulkBranch &&);
+  BulkBranch & operator=(BulkBranch &&);
+  ~BulkBranch();
+
+  /*!\brief Copy value of an entry from the basket holding it
+
+    \param[in] branch Branch of a fixed-size numeric variable
+
+    \param[in] tree_offset First chain entry of the tree owning branch
+
+    \param[in] entry Entry number within the tree
+
+    \param[out] value Value of the entry
+
+    \return False if the branch cannot be read in bulk, in which case value is
+    not modified
+  */
+  template<typename T>
+  bool Read(TBranch *branch, long tree_offset, long entry, T &value){
+    const char *data = Find(branch, tree_offset, entry, sizeof(T));
+    if(data == nullptr) return false;
+    std::memcpy(&value, data, sizeof(T));
+    return true;
+  }
+
+private:
+  std::unique_ptr<TBufferFile> buffer_;//!<Deserialized entries of the last basket read
+  long first_entry_;//!<Chain entry of the first value in buffer_
+  long end_entry_;//!<One past the chain entry of the last value in buffer_
+  bool supported_;//!<Whether bulk reading has worked for this branch so far
+
+  const char * Find(TBranch *branch, long tree_offset, long entry, std::size_t size);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef H_BYTECODE
+#define H_BYTECODE
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "core/baby.hpp"
+
+class Bytecode{
+public:
+  using ScalarType = double;
+  using VectorType = std::vector<ScalarType>;
+  using ScalarFunc = ScalarType(const Baby &);
+  using VectorFunc = VectorType(const Baby &);
+  using Pointer = std::shared_ptr<const Bytecode>;
+
+  enum class Operator{plus, minus, multiplies, divides, modulus,
+      equal, not_equal, greater, less, greater_equal, less_equal,
+      logical_and, logical_or, subscript};
+
+  enum class UnaryOperator{negate, logical_not};
+
+  static Pointer Constant(ScalarType x);
+  static Pointer Call(const std::function<ScalarFunc> &function);
+  static Pointer Call(const std::function<VectorFunc> &function);
+  static Pointer Apply(UnaryOperator op, const Pointer &a);
+  static Pointer Apply(Operator op, const Pointer &a, const Pointer &b);
+
+  ~Bytecode() = default;
+
+  bool IsScalar() const;
+  bool IsVector() const;
+  std::size_t NumInstructions() const;
+
+  bool Applies(Operator op) const;
+  const Pointer & LeftOperand() const;
+  const Pointer & RightOperand() const;
+
+  ScalarType GetScalar(const Baby &b) const;
+  VectorType GetVector(const Baby &b) const;
+
+private:
+  enum class OpCode{constant, call_scalar, call_vector,
+      negate_scalar, negate_vector, not_scalar, not_vector,
+      binary_ss, binary_sv, binary_vs, binary_vv, subscript,
+      jump_if_false, jump_if_true, to_bool, skip_if_none, skip_if_all};
+
+  struct Instruction{
+    OpCode code_;//!<What to do
+    Operator op_;//!<Operator applied by the binary_* op codes
+    std::size_t arg_;//!<Index of function to call or number of instructions to skip
+    ScalarType value_;//!<Value pushed by OpCode::constant
+  };
+
+  //!Flat list of instructions and the functions they call
+  struct Program{
+    std::vector<Instruction> code_;//!<Instructions, executed in order
+    std::vector<std::function<ScalarFunc> > scalar_calls_;//!<Scalar functions called by OpCode::call_scalar
+    std::vector<std::function<VectorFunc> > vector_calls_;//!<Vector functions called by OpCode::call_vector
+
+    void Append(const Program &other);
+    void Push(OpCode code, Operator op = Operator::plus, std::size_t arg = 0, ScalarType value = 0.);
+  };
+
+  struct Frame;
+  class FrameGuard;
+
+  Bytecode();
+  Bytecode(const Bytecode &) = delete;
+  Bytecode & operator=(const Bytecode &) = delete;
+  Bytecode(Bytecode &&) = delete;
+  Bytecode & operator=(Bytecode &&) = delete;
+
+  Pointer lhs_;//!<Operand of a unary operator or left hand operand of a binary one. Null for constants and calls.
+  Pointer rhs_;//!<Right hand operand of a binary operator. Null otherwise.
+  Operator op_;//!<Binary operator applied to lhs_ and rhs_
+  UnaryOperator unary_op_;//!<Unary operator applied to lhs_ if rhs_ is null
+  std::size_t num_instructions_;//!<Length of the flat program
+  std::size_t scalar_depth_;//!<Maximum size of the scalar stack
+  std::size_t vector_depth_;//!<Maximum size of the vector stack
+  bool is_scalar_;//!<Whether the result is left on the scalar stack
+  mutable Program program_;//!<Flat program. Set on construction for constants and calls, on first run otherwise.
+  mutable std::once_flag flatten_once_;//!<Guards the construction of program_
+
+  void Emit(Program &program) const;
+  const Program & GetProgram() const;
+  void Run(const Baby &b, Frame &frame) const;
+};
+
+#endif
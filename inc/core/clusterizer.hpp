@@ -1,6 +1,7 @@
 #ifndef H_CLUSTERIZER
 #define H_CLUSTERIZER
 
+#include <array>
 #include <list>
 #include <set>
 #include <vector>
@@ -41,7 +42,14 @@ namespace Clustering{
                          long max_points = -1);
 
     void AddPoint(float x, float y, float w);
-    
+    void AddBinned(const std::vector<double> &sumw,
+                   const std::vector<double> &sumw2,
+                   const std::array<double, 7> &stats,
+                   double entries,
+                   const std::vector<Point> &points,
+                   bool all_points);
+    long MaxPoints() const;
+
     void SetPoints(const std::vector<Point> &points);
     void SetPoints(const TH2D &h);
 
@@ -0,0 +1,131 @@
+#ifndef H_COLUMN_CACHE
+#define H_COLUMN_CACHE
+
+#include <cstddef>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+class ColumnCache{
+public:
+  //!Type-independent part of a column: which entries have been stored
+  class ColumnBase{
+  public:
+    explicit ColumnBase(long num_entries);
+    ColumnBase(const ColumnBase &) = delete;
+    ColumnBase & operator=(const ColumnBase &) = delete;
+    virtual ~ColumnBase() = default;
+
+    bool IsFilled(const std::vector<long> *entries) const;
+
+  protected:
+    long num_entries_;//!<Number of entries in the column
+    std::unique_ptr<bool[]> filled_;//!<Whether each entry has been stored
+    mutable bool complete_;//!<Whether every entry is known to be stored
+  };
+
+  //!Values of one branch for every entry, each marked when it is filled
+  template<typename T>
+  class Column: public ColumnBase{
+  public:
+    explicit Column(long num_entries):
+      ColumnBase(num_entries),
+      values_(new T[static_cast<std::size_t>(num_entries)]){
+    }
+
+    /*!\brief Get value of an entry, if it has been stored
+
+      \param[in] entry TChain entry
+
+      \param[out] value Stored value. Not modified if the entry was not filled.
+
+      \return True if the entry was filled
+    */
+    bool Read(long entry, T &value) const{
+      if(!filled_[entry]) return false;
+      value = values_[entry];
+      return true;
+    }
+
+    /*!\brief Store value of an entry
+
+      Different entries may be written by different threads at the same time.
+
+      \param[in] entry TChain entry
+
+      \param[in] value Value read from the branch
+    */
+    void Write(long entry, const T &value){
+      values_[entry] = value;
+      filled_[entry] = true;
+    }
+
+  private:
+    std::unique_ptr<T[]> values_;//!<Value of each entry
+  };
+
+  explicit ColumnCache(long num_entries);
+  ColumnCache(const ColumnCache &) = delete;
+  ColumnCache & operator=(const ColumnCache &) = delete;
+  ColumnCache(ColumnCache &&) = delete;
+  ColumnCache & operator=(ColumnCache &&) = delete;
+  ~ColumnCache();
+
+  template<typename T>
+  Column<T> * Find(const std::string &name) const;
+
+  template<typename T>
+  Column<T> * Add(const std::string &name, double max_megabytes);
+
+  std::set<std::string> FilledColumns(const std::vector<long> *entries) const;
+
+  static double MegabytesUsed();
+
+private:
+  long num_entries_;//!<Number of entries in each column
+  std::map<std::string, std::unique_ptr<ColumnBase> > columns_;//!<Columns, by branch name
+  std::size_t bytes_;//!<Memory held by the columns of this cache
+
+  static std::atomic<std::size_t> total_bytes_;//!<Memory held by all caches
+
+  bool Reserve(std::size_t bytes, double max_megabytes);
+};
+
+/*!\brief Get column of a branch
+
+  \param[in] name Name of the branch
+
+  \return Column, or nullptr if the branch is not cached with type T
+*/
+template<typename T>
+ColumnCache::Column<T> * ColumnCache::Find(const std::string &name) const{
+  auto found = columns_.find(name);
+  if(found == columns_.cend()) return nullptr;
+  return dynamic_cast<Column<T>*>(found->second.get());
+}
+
+/*!\brief Add an empty column for a branch, if it fits in the memory budget
+
+  Not thread safe. Columns must be added before the Babies reading them are
+  activated.
+
+  \param[in] name Name of the branch
+
+  \param[in] max_megabytes Maximum memory used by the columns of all caches
+
+  \return New or existing column, or nullptr if it does not fit
+*/
+template<typename T>
+ColumnCache::Column<T> * ColumnCache::Add(const std::string &name, double max_megabytes){
+  if(columns_.find(name) != columns_.cend()) return Find<T>(name);
+  if(!Reserve(static_cast<std::size_t>(num_entries_)*(sizeof(T)+sizeof(bool)), max_megabytes)) return nullptr;
+  Column<T> *column = new Column<T>(num_entries_);
+  columns_[name].reset(column);
+  return column;
+}
+
+#endif
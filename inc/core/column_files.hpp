@@ -0,0 +1,39 @@
+#ifndef H_COLUMN_FILES
+#define H_COLUMN_FILES
+
+#include <cstddef>
+
+#include <map>
+#include <string>
+#include <utility>
+
+class ColumnFiles{
+public:
+  explicit ColumnFiles(const std::string &root_file);
+  ColumnFiles(const ColumnFiles &) = delete;
+  ColumnFiles & operator=(const ColumnFiles &) = delete;
+  ColumnFiles(ColumnFiles &&) = delete;
+  ColumnFiles & operator=(ColumnFiles &&) = delete;
+  ~ColumnFiles();
+
+  static const std::string & CacheDirectory();
+  static void CacheDirectory(const std::string &directory);
+
+  static std::string Directory(const std::string &root_file);
+  static std::string ColumnPath(const std::string &root_file, const std::string &branch);
+  static void WriteManifest(const std::string &root_file, long num_entries,
+                            const std::map<std::string, std::string> &types);
+
+  bool IsValid() const;
+  long NumEntries() const;
+  const void * Find(const std::string &branch, const std::string &type, std::size_t size);
+  bool IsMapped(const std::string &branch) const;
+
+private:
+  std::string root_file_;//!<Ntuple whose branches are stored
+  long num_entries_;//!<Number of entries in each column. Negative if the manifest is missing or stale.
+  std::map<std::string, std::string> types_;//!<Type of each stored branch, as in txt/variables
+  std::map<std::string, std::pair<void*, std::size_t> > mappings_;//!<Address and length of each mapped column
+};
+
+#endif
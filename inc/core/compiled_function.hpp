@@ -0,0 +1,39 @@
+#ifndef H_COMPILED_FUNCTION
+#define H_COMPILED_FUNCTION
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Baby;
+
+class CompiledFunction{
+public:
+  using Pointer = double (*)(const Baby &);
+  using Implementation = std::pair<std::size_t, Pointer>;
+
+  CompiledFunction(const std::string &expression,
+                   const std::vector<Implementation> &implementations);
+  CompiledFunction(const CompiledFunction &) = default;
+  CompiledFunction & operator=(const CompiledFunction &) = default;
+  CompiledFunction(CompiledFunction &&) = default;
+  CompiledFunction & operator=(CompiledFunction &&) = default;
+  ~CompiledFunction() = default;
+
+  static const CompiledFunction * Find(const std::string &expression);
+
+  const std::string & Expression() const;
+  std::size_t NumImplementations() const;
+  Pointer Get(const Baby &b) const;
+  Pointer Get(std::size_t type_number) const;
+
+private:
+  static const std::vector<CompiledFunction> & Registry();
+
+  std::string expression_;//!<Expression without spaces, as seen by FunctionParser
+  std::vector<Pointer> functions_;//!<Compiled function indexed by Baby::TypeNumber(). Null where not valid.
+  std::size_t num_implementations_;//!<Number of Baby types with a compiled function
+};
+
+#endif
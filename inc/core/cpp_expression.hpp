@@ -0,0 +1,162 @@
+#ifndef H_CPP_EXPRESSION
+#define H_CPP_EXPRESSION
+
+// Translation of NamedFunc strings into C++ source code. Header-only so that
+// it can be used both by generate_baby.exe, which is built without the rest of
+// the library, and by the run-time JIT in NamedFunc.
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace CppExpression{
+  /*!\brief Translates a variable name into C++ code
+
+    Returns false if the variable cannot be used in compiled code.
+  */
+  using VariableTranslator = std::function<bool(const std::string &name, std::string &code)>;
+
+  /*!\brief Splits an expression into tokens following FunctionParser::Tokenize()
+
+    \param[in] expression Expression without spaces
+
+    \param[out] tokens Numbers, variable names, operators, and parentheses
+
+    \return False if the expression contains anything not supported by the
+    generated code, like brackets
+  */
+  inline bool Tokenize(const std::string &expression, std::vector<std::string> &tokens){
+    const std::vector<std::string> operators = {"==", "!=", "<=", ">=", "&&", "||",
+                                                "+", "-", "*", "/", "%", "<", ">", "!", "(", ")"};
+    tokens.clear();
+    std::size_t start = 0;
+    while(start < expression.size()){
+      char start_char = expression.at(start);
+      std::string op = "";
+      for(const auto &candidate: operators){
+        if(expression.compare(start, candidate.size(), candidate) == 0){
+          op = candidate;
+          break;
+        }
+      }
+      if(op != ""){
+        tokens.push_back(op);
+        start += op.size();
+      }else if(isalpha(start_char) || start_char == '_'){
+        std::size_t count = 1;
+        while(start+count < expression.size()
+              && (isalnum(expression.at(start+count)) || expression.at(start+count) == '_')){
+          ++count;
+        }
+        tokens.push_back(expression.substr(start, count));
+        start += count;
+      }else if(isdigit(start_char) || start_char == '.'){
+        std::string from_start = expression.substr(start);
+        char *cp = nullptr;
+        strtod(from_start.c_str(), &cp);
+        std::size_t length = cp - from_start.c_str();
+        if(length == 0) return false;
+        tokens.push_back(from_start.substr(0, length));
+        start += length;
+      }else{
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /*!\brief Translates tokens starting at pos into C++ code
+
+    Uses the same precedence as FunctionParser, from "||" (level 0) to "*", "/",
+    and "%" (level 5), followed by unary operators and operands. Every
+    subexpression is a double, as in NamedFunc.
+
+    \param[in] tokens Tokens of the full expression
+
+    \param[in,out] pos Position of next unparsed token
+
+    \param[in] level Precedence level to parse
+
+    \param[in] variable Translates variable names
+
+    \param[out] code C++ expression
+
+    \return False if the tokens do not form a valid scalar expression
+  */
+  inline bool Translate(const std::vector<std::string> &tokens, std::size_t &pos, std::size_t level,
+                        const VariableTranslator &variable, std::string &code){
+    const std::vector<std::vector<std::string> > levels = {{"||"}, {"&&"}, {"==", "!="},
+                                                           {"<", ">", "<=", ">="}, {"+", "-"}, {"*", "/", "%"}};
+    if(level < levels.size()){
+      if(!Translate(tokens, pos, level+1, variable, code)) return false;
+      const auto &ops = levels.at(level);
+      while(pos < tokens.size() && std::find(ops.cbegin(), ops.cend(), tokens.at(pos)) != ops.cend()){
+        std::string op = tokens.at(pos++);
+        std::string rhs;
+        if(!Translate(tokens, pos, level+1, variable, rhs)) return false;
+        if(op == "%"){
+          code = "std::fmod("+code+", "+rhs+")";
+        }else if(level >= 4){
+          code = "("+code+op+rhs+")";
+        }else{
+          code = "static_cast<double>("+code+op+rhs+")";
+        }
+      }
+      return true;
+    }
+
+    if(pos >= tokens.size()) return false;
+    std::string token = tokens.at(pos++);
+    if(token == "+" || token == "-" || token == "!"){
+      std::string operand;
+      if(!Translate(tokens, pos, level, variable, operand)) return false;
+      if(token == "+") code = operand;
+      else if(token == "-") code = "(-"+operand+")";
+      else code = "static_cast<double>(!"+operand+")";
+      return true;
+    }else if(token == "("){
+      if(!Translate(tokens, pos, 0, variable, code)) return false;
+      if(pos >= tokens.size() || tokens.at(pos) != ")") return false;
+      ++pos;
+      code = "("+code+")";
+      return true;
+    }else if(isalpha(token.at(0)) || token.at(0) == '_'){
+      return variable(token, code);
+    }else if(isdigit(token.at(0)) || token.at(0) == '.'){
+      double value = strtod(token.c_str(), nullptr);
+      if(!std::isfinite(value)) return false;
+      std::ostringstream oss;
+      oss << std::hexfloat << value;
+      code = oss.str();
+      return true;
+    }
+    return false;
+  }
+
+  /*!\brief Translates an expression into C++ code returning a double
+
+    \param[in] expression Expression without spaces
+
+    \param[in] variable Translates variable names
+
+    \param[out] code C++ expression
+
+    \return False if the expression cannot be compiled, or is just a constant or
+    a variable
+  */
+  inline bool Translate(const std::string &expression, const VariableTranslator &variable,
+                        std::string &code){
+    std::vector<std::string> tokens;
+    if(!Tokenize(expression, tokens) || tokens.size() < 2) return false;
+    std::size_t pos = 0;
+    return Translate(tokens, pos, 0, variable, code) && pos == tokens.size();
+  }
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef H_ENTRY_LISTS
+#define H_ENTRY_LISTS
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace EntryLists{
+  const std::string & CacheDirectory();
+  void CacheDirectory(const std::string &directory);
+
+  std::string Key(const std::set<std::string> &file_names, const std::string &cut);
+  bool Read(const std::string &key, std::vector<long> &entries);
+  void Write(const std::string &key, const std::vector<long> &entries);
+}
+
+#endif
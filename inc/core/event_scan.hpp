@@ -1,13 +1,16 @@
 #ifndef H_EVENT_SCAN
 #define H_EVENT_SCAN
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
 #include <fstream>
+#include <thread>
 
 #include "core/figure.hpp"
 #include "core/process.hpp"
+#include "core/ring_buffer.hpp"
 
 class EventScan final : public Figure{
  public:
@@ -15,11 +18,21 @@ class EventScan final : public Figure{
  public:
    SingleScan(const EventScan &event_scan,
               const std::shared_ptr<Process> &process);
-   ~SingleScan() = default;
+   ~SingleScan();
 
-   void RecordEvent(const Baby &baby) final;
+   void ReserveShards(std::size_t num_shards) final;
+   void RecordEvent(const Baby &baby,
+                    const NamedFunc::VectorType *proc_cut_vector,
+                    std::size_t ishard) final;
+   void MergeShard(std::size_t ishard) final;
+   std::vector<NamedFunc> GetFunctions() const final;
 
    void Precision(unsigned precision);
+   void Binary(bool binary);
+   void Flush();
+
+   std::string TextPath() const;
+   std::string BinaryPath() const;
 
  private:
    SingleScan() = delete;
@@ -28,11 +41,43 @@ class EventScan final : public Figure{
    SingleScan(SingleScan &&) = delete;
    SingleScan& operator=(SingleScan &&) = delete;
 
+   //!Values of the lines printed while processing a single entry range
+   class Shard{
+   public:
+     explicit Shard(std::size_t num_columns);
+
+     std::vector<NamedFunc::ScalarType> values_;//!<Value of each column of each printed line
+     std::vector<char> has_value_;//!<Whether each entry of values_ is printed. Vector columns may be shorter than others.
+     std::vector<std::size_t> line_rows_;//!<Row number within the range of each printed line
+     std::vector<std::size_t> line_instances_;//!<Object printed in each line, or NoInstance() for scalar scans
+     std::size_t num_rows_;//!<Number of rows printed for the range
+     NamedFunc::VectorType cut_vector_;//!<Cut results (to avoid creating new vector each event)
+     std::vector<NamedFunc::VectorType> val_vectors_;//!<Values for each column (to avoid creating new vectors each event)
+   };
+
+   static constexpr std::size_t NoInstance(){return static_cast<std::size_t>(-1);}
+
+   void OpenOutput();
+   void StopWriter();
+   void WriteShards();
+   void WriteShard(const Shard &shard);
+   void WriteText(const Shard &shard);
+   void WriteColumns(const Shard &shard);
+   void WriteManifest() const;
+
    std::ofstream out_;//!<File to which results are printed
-   NamedFunc full_cut_;//!<Cached scan&&process cut
-   NamedFunc::VectorType cut_vector_;//!<Cut results (to avoid creating new vector each event)
-   std::vector<NamedFunc::VectorType> val_vectors_;//!<Values for each column (to avoid creating new vectors each event)
-   std::size_t row_;
+   std::vector<std::unique_ptr<std::ofstream> > column_files_;//!<Row, instance (for vector scans), and value column files of binary scans
+   std::vector<std::string> column_names_;//!<Name of the file of each entry of column_files_, without extension
+   std::size_t num_lines_;//!<Number of lines written to the column files
+   bool binary_;//!<Whether values are written to column files instead of text
+   bool is_vector_;//!<Whether the scan&&process cut has per-object results
+   std::vector<std::unique_ptr<Shard> > shards_;//!<Printed values, one set for each entry range
+   std::size_t row_;//!<Number of rows written. Only used by the writer thread while it runs.
+   unsigned precision_;//!<Significant digits of printed values
+   std::string buffer_;//!<Formatted lines not yet written to out_
+   RingBuffer<std::unique_ptr<Shard> > pending_;//!<Merged ranges waiting for the writer thread
+   std::atomic<bool> stop_writer_;//!<Tells the writer thread to exit once pending_ is empty
+   std::thread writer_;//!<Thread formatting and writing the merged ranges
  };
 
  EventScan(const std::string &name,
@@ -53,6 +98,8 @@ class EventScan final : public Figure{
 
  unsigned Precision() const;
  EventScan & Precision(unsigned precision);
+ bool Binary() const;
+ EventScan & Binary(bool binary = true);
 
  std::string name_;//!<Name of scan for saving to file
  NamedFunc cut_;//!<Cut restricting printed events/objects
@@ -62,6 +109,7 @@ class EventScan final : public Figure{
  std::vector<std::unique_ptr<SingleScan> > scans_;//!<One scan for each process
  unsigned precision_;//!<Decimal places to print
  unsigned width_;//!<Width of column in characters. Determined from precision
+ bool binary_;//!<Whether values are written to column files instead of text
  
  EventScan(const EventScan &) = delete;
  EventScan& operator=(const EventScan &) = delete;
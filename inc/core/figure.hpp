@@ -3,7 +3,6 @@
 
 #include <memory>
 #include <vector>
-#include <mutex>
 
 #include "core/process.hpp"
 #include "core/baby.hpp"
@@ -17,11 +16,22 @@ public:
                     const std::shared_ptr<Process> &process);
     virtual ~FigureComponent() = default;
 
-    virtual void RecordEvent(const Baby &baby) = 0;
+    virtual void ReserveShards(std::size_t num_shards) = 0;
+    virtual void RecordEvent(const Baby &baby,
+                             const NamedFunc::VectorType *proc_cut_vector,
+                             std::size_t ishard) = 0;
+    virtual void MergeShard(std::size_t ishard) = 0;
+    virtual std::vector<NamedFunc> GetFunctions() const = 0;
 
     const Figure& figure_;//!<Reference to figure containing this component
     std::shared_ptr<Process> process_;//!<Process associated to this part of the figure
-    std::mutex mutex_;
+
+  protected:
+    static bool EvaluateCut(const NamedFunc &cut,
+                            const Baby &baby,
+                            const NamedFunc::VectorType *proc_cut_vector,
+                            NamedFunc::VectorType &cut_vector,
+                            bool &cut_is_vector);
 
   private:
     FigureComponent() = delete;
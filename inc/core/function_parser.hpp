@@ -49,6 +49,7 @@ private:
   void EqualOrNot() const;
   void And() const;
   void Or() const;
+  void MergeChains(Token::Type op) const;
   void CheckSolved() const;
   void CleanupName() const;
 
@@ -69,4 +69,10 @@ void WriteSpecializedSource(const std::set<Variable> &vars,
 void WriteMergedHeader(const std::set<Variable> &vars,
                        const std::vector<std::string> &types);
 
+std::set<std::string> CollectExpressions(const std::vector<std::string> &files);
+
+void WriteCompiledFunctions(const std::set<Variable> &vars,
+                            const std::vector<std::string> &types,
+                            const std::set<std::string> &expressions);
+
 #endif
@@ -30,9 +30,17 @@ public:
     ~SingleHist1D() = default;
 
     TH1D raw_hist_;//!<Histogram storing distribution before stacking and luminosity weighting
+    std::vector<TH1D> variation_hists_;//!<Distribution with each weight variation, before stacking and luminosity weighting
     mutable TH1D scaled_hist_;//!<Kludge. Mutable storage of scaled and stacked histogram
 
-    void RecordEvent(const Baby &baby) final;
+    void ReserveShards(std::size_t num_shards) final;
+    void RecordEvent(const Baby &baby,
+                     const NamedFunc::VectorType *proc_cut_vector,
+                     std::size_t ishard) final;
+    void MergeShard(std::size_t ishard) final;
+    std::vector<NamedFunc> GetFunctions() const final;
+
+    void UpdateRawHist();
 
     double GetMax(double max_bound = std::numeric_limits<double>::infinity(),
                   bool include_error_bar = false,
@@ -49,9 +57,61 @@ public:
     SingleHist1D(SingleHist1D &&) = delete;
     SingleHist1D& operator=(SingleHist1D &&) = delete;
 
-    NamedFunc proc_and_hist_cut_;
+    //!Sums of weights per bin, filled without going through TH1D
+    class Accumulator{
+    public:
+      explicit Accumulator(const TAxis &axis);
+
+      int Fill(double x, double w);
+      void Add(const Accumulator &other);
+      void AddTo(TH1D &hist) const;
+      void Clear();
+
+    private:
+      int nbins_;//!<Number of bins, excluding under- and overflow
+      double xmin_, xmax_;//!<Range of the axis
+      std::vector<double> edges_;//!<Bin edges if the bins have variable width. Empty otherwise.
+      std::vector<double> sumw_;//!<Sum of weights in each bin, including under- and overflow
+      std::vector<double> sumw2_;//!<Sum of squared weights in each bin, including under- and overflow
+      double entries_;//!<Number of fills
+      double tsumw_, tsumw2_, tsumwx_, tsumwx2_;//!<In-range statistics, as kept by TH1
+    };
+
+    //!Sums of weights per bin for several weight variations
+    class VariationSums{
+    public:
+      VariationSums(std::size_t num_cells, std::size_t num_variations);
+
+      void Fill(int bin, double w, const NamedFunc::VectorType &variation_weights);
+      void Add(const VariationSums &other);
+      void AddTo(std::vector<TH1D> &hists) const;
+      void Clear();
+      std::size_t NumVariations() const;
+
+    private:
+      std::size_t num_variations_;//!<Number of weight variations
+      std::vector<double> sumw_;//!<Sum of weights, indexed by bin*num_variations_+variation
+      std::vector<double> sumw2_;//!<Sum of squared weights, indexed as sumw_
+    };
+
+    //!Partial histogram filled while processing a single entry range
+    class Shard{
+    public:
+      Shard(const TAxis &axis, std::size_t num_variations);
+
+      Accumulator sums_;//!<Sums of weights of the range
+      VariationSums variation_sums_;//!<Sums of the varied weights of the range
+      NamedFunc::VectorType variation_weights_;//!<Weight variations of the current event
+      NamedFunc::VectorType cut_vector_, wgt_vector_, val_vector_;
+    };
+
+    std::size_t NumVariations() const;
+
+    NamedFunc hist_cut_;
     NamedFunc xvar_, weight_;
-    NamedFunc::VectorType cut_vector_, wgt_vector_, val_vector_;
+    std::vector<std::unique_ptr<Shard> > shards_;//!<Partial histograms, one for each entry range
+    Accumulator sums_;//!<Sums of the merged ranges not yet added to raw_hist_
+    VariationSums variation_sums_;//!<Sums of the merged ranges not yet added to variation_hists_
   };
 
   Hist1D(const Axis &xaxis, const NamedFunc &cut,
@@ -81,6 +141,7 @@ public:
   Hist1D & RatioTitle(const std::string &numerator,
                       const std::string &denominator);
   Hist1D & ShowLumi(const bool &show_lumi);
+  Hist1D & Variations(const std::vector<NamedFunc> &variations);
 
   Axis xaxis_;//!<Specification of content: plotted variable, binning, etc.
   NamedFunc cut_;//!<Event selection
@@ -95,6 +156,7 @@ public:
   std::string ratio_numerator_;//!<Label for numerator in ratio plot
   std::string ratio_denominator_;//!<Label for denominator in ratio plot
   std::vector<PlotOpt> plot_options_;//!<Styles with which to draw plot
+  std::vector<NamedFunc> variations_;//!<Weight variations multiplying the weight of each MC process
   
 private:
   bool show_lumi_; //!<Show luminosity in plot
@@ -115,6 +177,7 @@ private:
   Hist1D& operator=(const Hist1D &) = delete;
   Hist1D() = delete;
 
+  void WriteVariations(const std::string &base_name) const;
   void RefreshScaledHistos();
   void InitializeHistos() const;
   void MergeOverflow() const;
@@ -1,6 +1,8 @@
 #ifndef H_HIST2D
 #define H_HIST2D
 
+#include <array>
+
 #include "TH2D.h"
 #include "TGraph.h"
 #include "TLine.h"
@@ -12,9 +14,9 @@
 #include "core/plot_opt.hpp"
 #include "core/clusterizer.hpp"
 
-class Hist2D: public Figure{
+class Hist2D final: public Figure{
 public:
-  class SingleHist2D: public Figure::FigureComponent{
+  class SingleHist2D final: public Figure::FigureComponent{
   public:
     SingleHist2D(const Hist2D &figure,
                  const std::shared_ptr<Process> &process,
@@ -23,7 +25,12 @@ public:
 
     Clustering::Clusterizer clusterizer_;
 
-    void RecordEvent(const Baby &baby);
+    void ReserveShards(std::size_t num_shards) final;
+    void RecordEvent(const Baby &baby,
+                     const NamedFunc::VectorType *proc_cut_vector,
+                     std::size_t ishard) final;
+    void MergeShard(std::size_t ishard) final;
+    std::vector<NamedFunc> GetFunctions() const final;
 
   private:
     SingleHist2D() = delete;
@@ -32,8 +39,27 @@ public:
     SingleHist2D(SingleHist2D &&) = delete;
     SingleHist2D& operator=(SingleHist2D &&) = delete;
 
-    NamedFunc proc_and_hist_cut_;
-    NamedFunc::VectorType cut_vector_, wgt_vector_, xval_vector_, yval_vector_;
+    //!Binned sums, and points up to the clusterizer limit, recorded while
+    //!processing a single entry range
+    class Shard{
+    public:
+      Shard(std::size_t num_cells, long max_points);
+
+      std::vector<double> sumw_;//!<Sum of weights in each global bin
+      std::vector<double> sumw2_;//!<Sum of squared weights in each global bin
+      std::array<double, 7> stats_;//!<In-range statistics, as kept by TH2
+      double entries_;//!<Number of fills
+      std::vector<Clustering::Point> points_;//!<Points in the order they were recorded, while all_points_
+      long max_points_;//!<Number of points above which they are dropped. Negative if unlimited.
+      bool all_points_;//!<Whether points_ holds every fill
+      NamedFunc::VectorType cut_vector_, wgt_vector_, xval_vector_, yval_vector_;
+    };
+
+    void Fill(Shard &shard, float x, float y, float w) const;
+
+    NamedFunc hist_cut_;
+    std::vector<double> x_edges_, y_edges_;//!<Bin edges of the histogram
+    std::vector<std::unique_ptr<Shard> > shards_;//!<Recorded fills, one set for each entry range
   };
 
   Hist2D(const Axis &xaxis, const Axis &yaxis, const NamedFunc &cut,
@@ -44,11 +70,11 @@ public:
   ~Hist2D() = default;
 
   void Print(double luminosity,
-             const std::string &subdir) override;
+             const std::string &subdir) final;
 
-  std::set<const Process*> GetProcesses() const override;
+  std::set<const Process*> GetProcesses() const final;
 
-  FigureComponent * GetComponent(const Process *process) override;
+  FigureComponent * GetComponent(const Process *process) final;
 
   std::string Name() const;
 
@@ -0,0 +1,42 @@
+#ifndef H_JIT_FUNCTION
+#define H_JIT_FUNCTION
+
+#include <cstddef>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Baby;
+
+class JitFunction{
+public:
+  using Pointer = double (*)(const Baby &);
+
+  JitFunction(const JitFunction &) = delete;
+  JitFunction & operator=(const JitFunction &) = delete;
+  JitFunction(JitFunction &&) = delete;
+  JitFunction & operator=(JitFunction &&) = delete;
+  ~JitFunction() = default;
+
+  static std::shared_ptr<const JitFunction> Find(const std::string &expression);
+
+  static const std::string & CacheDirectory();
+  static void CacheDirectory(const std::string &directory);
+  static void CompileAll(const std::vector<Baby*> &babies);
+
+  const std::string & Expression() const;
+  Pointer Get(const Baby &b) const;
+
+private:
+  explicit JitFunction(const std::string &expression);
+
+  std::string expression_;//!<Expression without spaces, as seen by FunctionParser
+  mutable std::vector<bool> compiled_;//!<Whether compilation was attempted, indexed by Baby::TypeNumber()
+  mutable std::vector<std::atomic<Pointer> > functions_;//!<Compiled function, indexed by Baby::TypeNumber(). Null if not (yet) compiled.
+
+  void Compile(const Baby &b) const;
+};
+
+#endif
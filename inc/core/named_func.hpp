@@ -3,12 +3,15 @@
 
 #include <string>
 #include <functional>
+#include <memory>
 #include <ostream>
+#include <set>
 #include <vector>
 
 #include "TString.h"
 
 #include "core/baby.hpp"
+#include "core/bytecode.hpp"
 
 class NamedFunc{
 public:
@@ -16,6 +19,7 @@ public:
   using VectorType = std::vector<ScalarType>;
   using ScalarFunc = ScalarType(const Baby &);
   using VectorFunc = VectorType(const Baby &);
+  using BranchSet = std::shared_ptr<const std::set<std::string> >;
 
   NamedFunc(const std::string &name,
             const std::function<ScalarFunc> &function);
@@ -36,13 +40,32 @@ public:
   std::string PlainName() const;
   std::string PrettyName() const;
 
+  const std::string & Key() const;
+  NamedFunc & Key(const std::string &key, bool cache_result = true);
+
   NamedFunc & Function(const std::function<ScalarFunc> &function);
   NamedFunc & Function(const std::function<VectorFunc> &function);
   const std::function<ScalarFunc> & ScalarFunction() const;
   const std::function<VectorFunc> & VectorFunction() const;
 
+  const Bytecode::Pointer & Code() const;
+  NamedFunc & Code(const Bytecode::Pointer &code);
+
+  const BranchSet & Branches() const;
+  NamedFunc & Branches(const std::set<std::string> &branches);
+  NamedFunc & Branches(const BranchSet &branches);
+
+  static bool UseBytecode();
+  static void UseBytecode(bool use);
+  static bool UseJit();
+  static void UseJit(bool use);
+  static long AdaptiveLogic();
+  static void AdaptiveLogic(long num_events);
+
   bool IsScalar() const;
   bool IsVector() const;
+  bool IsConstant() const;
+  ScalarType ConstantValue() const;
 
   ScalarType GetScalar(const Baby &b) const;
   VectorType GetVector(const Baby &b) const;
@@ -58,8 +81,13 @@ public:
 private:
   NamedFunc() = delete;
   std::string name_;//!<String representation of the function
+  std::string key_;//!<Canonical form of the expression, shared by identical NamedFuncs. Empty if unknown.
   std::function<ScalarFunc> scalar_func_;//<!Scalar function. Cannot be valid at same time as NamedFunc::vector_func_.
   std::function<VectorFunc> vector_func_;//<!Vector function. Cannot be valid at same time as NamedFunc::scalar_func_.
+  Bytecode::Pointer code_;//!<Flat representation of the function. Null if not available.
+  BranchSet branches_;//!<Names of the branches read by the function. Null if unknown.
+  bool is_constant_;//!<Whether the function is known to return constant_value_ for every Baby
+  ScalarType constant_value_;//!<Value of a constant function
 
   void CleanName();
 };
@@ -85,6 +113,9 @@ NamedFunc operator || (NamedFunc f, NamedFunc g);
 
 NamedFunc operator ! (NamedFunc f);
 
+NamedFunc AdaptiveAnd(const std::vector<NamedFunc> &terms);
+NamedFunc AdaptiveOr(const std::vector<NamedFunc> &terms);
+
 std::ostream & operator<<(std::ostream &stream, const NamedFunc &function);
 
 bool HavePass(const NamedFunc::VectorType &v);
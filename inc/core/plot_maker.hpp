@@ -42,14 +42,40 @@ public:
 
   bool multithreaded_;
   bool min_print_;
+  long entries_per_range_;//!<Maximum number of entries processed in a single task
+  bool select_branches_;//!<Read only the branches used by the figures, if all of them are known
+  Baby::CacheOptions cache_options_;//!<TTreeCache settings of the Babies without their own
+  double column_cache_mb_;//!<Memory for branch values kept between passes over the same Babies. 0 to disable.
+  bool use_entry_lists_;//!<Record the entries passing each Process cut, and only load those in later runs
 
 private:
+  using ProcFigs = std::vector<std::pair<const Process*, std::set<Figure::FigureComponent*> > >;
+
+  //!Contiguous block of entries from one Baby, processed as a single task
+  struct EntryRange{
+    Baby *baby_;//!<Baby whose files contain the entries
+    long first_entry_;//!<First entry in the range, or first index in entry_list_
+    long end_entry_;//!<One past the last entry in the range, or one past the last index in entry_list_
+    long baby_entries_;//!<Total number of entries in the Baby, or size of entry_list_
+    ProcFigs proc_figs_;//!<Processes using the Baby and the components they fill
+    NamedFunc::BranchSet branches_;//!<Branches to read for the processes and components, without those served from memory. Null to read all.
+    std::shared_ptr<const std::vector<long> > entry_list_;//!<Sorted entries passing some Process cut. Null to load all entries.
+    std::vector<std::string> list_keys_;//!<Key of the entry list recorded for each Process. Empty if not recording.
+    std::vector<std::vector<long> > passing_entries_;//!<Entries in the range passing each Process cut, if recording
+    long bytes_read_;//!<Bytes read from the ntuple files while processing the range
+  };
+
   std::vector<std::unique_ptr<Figure> > figures_;//!<Figures to be produced
 
   void GetYields();
-  long GetYield(Baby *baby_ptr);
+  long GetYield(EntryRange &range, std::size_t irange);
+  void MergeShards(const EntryRange &range, std::size_t irange);
 
-  std::set<Baby*> GetBabies() const;
+  std::vector<Baby*> GetBabies() const;
+  NamedFunc::BranchSet GetBranches(const ProcFigs &proc_figs) const;
+  std::shared_ptr<const std::vector<long> > GetEntryList(const Baby &baby, const ProcFigs &proc_figs,
+                                                         std::vector<std::string> &list_keys) const;
+  void WriteEntryLists(const std::vector<EntryRange> &ranges) const;
   std::set<const Process *> GetProcesses() const;
   std::set<Figure::FigureComponent*> GetComponents(const Process *process) const;
 };
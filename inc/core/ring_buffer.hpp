@@ -0,0 +1,78 @@
+#ifndef H_RING_BUFFER
+#define H_RING_BUFFER
+
+#include <cstddef>
+
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//!Fixed-size queue passing items from one producer thread to one consumer thread without locks
+template<typename T>
+class RingBuffer{
+public:
+  explicit RingBuffer(std::size_t capacity);
+  ~RingBuffer() = default;
+
+  void Push(T &&item);
+  bool TryPop(T &item);
+
+private:
+  RingBuffer() = delete;
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer& operator=(const RingBuffer &) = delete;
+  RingBuffer(RingBuffer &&) = delete;
+  RingBuffer& operator=(RingBuffer &&) = delete;
+
+  std::vector<T> slots_;//!<Storage for the queued items
+  std::atomic<std::size_t> head_;//!<Number of items pushed. Only written by the producer.
+  std::atomic<std::size_t> tail_;//!<Number of items popped. Only written by the consumer.
+};
+
+/*!\brief Standard constructor
+
+  \param[in] capacity Maximum number of queued items
+*/
+template<typename T>
+RingBuffer<T>::RingBuffer(std::size_t capacity):
+  slots_(capacity),
+  head_(0),
+  tail_(0){
+}
+
+/*!\brief Adds an item at the end of the queue, waiting for the consumer while
+  the queue is full
+
+  Must only be called from the producer thread.
+
+  \param[in] item Item to add
+*/
+template<typename T>
+void RingBuffer<T>::Push(T &&item){
+  std::size_t head = head_.load(std::memory_order_relaxed);
+  while(head - tail_.load(std::memory_order_acquire) >= slots_.size()){
+    std::this_thread::yield();
+  }
+  slots_[head % slots_.size()] = std::move(item);
+  head_.store(head+1, std::memory_order_release);
+}
+
+/*!\brief Takes the item at the front of the queue, if any
+
+  Must only be called from the consumer thread.
+
+  \param[out] item Item taken from the queue. Unchanged if the queue is empty.
+
+  \return False if the queue is empty
+*/
+template<typename T>
+bool RingBuffer<T>::TryPop(T &item){
+  std::size_t tail = tail_.load(std::memory_order_relaxed);
+  if(tail == head_.load(std::memory_order_acquire)) return false;
+  item = std::move(slots_[tail % slots_.size()]);
+  tail_.store(tail+1, std::memory_order_release);
+  return true;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef H_SKIM
+#define H_SKIM
+
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "core/figure.hpp"
+#include "core/process.hpp"
+
+class Skim final : public Figure{
+ public:
+  class SingleSkim final : public Figure::FigureComponent{
+ public:
+   SingleSkim(const Skim &skim,
+              const std::shared_ptr<Process> &process);
+   ~SingleSkim();
+
+   void ReserveShards(std::size_t num_shards) final;
+   void RecordEvent(const Baby &baby,
+                    const NamedFunc::VectorType *proc_cut_vector,
+                    std::size_t ishard) final;
+   void MergeShard(std::size_t ishard) final;
+   std::vector<NamedFunc> GetFunctions() const final;
+
+   std::string OutputPath() const;
+   bool MergeFiles();
+
+ private:
+   std::string ShardPath(std::size_t ishard) const;
+   void RemoveShards();
+
+   SingleSkim() = delete;
+   SingleSkim(const SingleSkim &) = delete;
+   SingleSkim& operator=(const SingleSkim &) = delete;
+   SingleSkim(SingleSkim &&) = delete;
+   SingleSkim& operator=(SingleSkim &&) = delete;
+
+   //!Value of a copied branch, stored with the type of the input branch
+   struct BranchValue{
+     char type_;//!<ROOT leaf type code (D, F, I, S, i, l, or O)
+     union{
+       Double_t d_;
+       Float_t f_;
+       Int_t i_;
+       Short_t s_;
+       UInt_t u_;
+       ULong64_t l_;
+       Bool_t o_;
+     };
+   };
+
+   //!Temporary file holding the events of a single entry range
+   class Shard{
+   public:
+     Shard(const std::string &path, const Skim &skim, const Baby &baby);
+     ~Shard();
+
+     void Fill(const Skim &skim, const Baby &baby);
+
+     std::string path_;//!<Path to the temporary file
+     std::unique_ptr<TFile> file_;//!<Temporary file
+     TTree *tree_;//!<Tree of skimmed events, owned by file_
+     std::vector<BranchValue> branch_values_;//!<Values of the copied branches
+     std::vector<Double_t> scalar_values_;//!<Values of the scalar computed columns
+     std::vector<std::vector<Double_t> > vector_values_;//!<Values of the vector computed columns
+     std::vector<std::vector<Double_t>*> vector_addresses_;//!<Addresses given to the vector branches
+     NamedFunc::VectorType cut_vector_;//!<Cut results (to avoid creating new vector each event)
+   };
+
+   std::vector<std::unique_ptr<Shard> > shards_;//!<Events being written, one file for each entry range
+   std::vector<std::string> shard_paths_;//!<Finished temporary files, in range order
+   std::string tree_name_;//!<Name of the input tree, reused for the output
+ };
+
+ Skim(const std::string &name,
+      const NamedFunc &cut,
+      const std::vector<std::string> &branches,
+      const std::vector<NamedFunc> &columns,
+      const std::vector<std::shared_ptr<Process> > &processes);
+ Skim(Skim &&) = default;
+ Skim& operator=(Skim &&) = default;
+ ~Skim() = default;
+
+ void Print(double luminosity,
+            const std::string &subdir) final;
+
+ std::set<const Process*> GetProcesses() const final;
+
+ FigureComponent * GetComponent(const Process *process) final;
+
+ std::string name_;//!<Name of skim for saving to file
+ NamedFunc cut_;//!<Cut restricting written events
+ std::vector<std::string> branches_;//!<Branches copied from the input
+ std::vector<NamedFunc> branch_funcs_;//!<Functions reading the copied branches
+ std::vector<NamedFunc> columns_;//!<Computed columns, written as Double_t or vector<Double_t>
+
+ private:
+ std::vector<std::unique_ptr<SingleSkim> > skims_;//!<One skim for each process
+
+ Skim(const Skim &) = delete;
+ Skim& operator=(const Skim &) = delete;
+ Skim() = delete;
+};
+
+#endif
@@ -21,7 +21,12 @@ public:
                 std::vector<NamedFunc> &cuts);
     ~TableColumn() = default;
 
-    void RecordEvent(const Baby &baby) final;
+    void ReserveShards(std::size_t num_shards) final;
+    void RecordEvent(const Baby &baby,
+                     const NamedFunc::VectorType *proc_cut_vector,
+                     std::size_t ishard) final;
+    void MergeShard(std::size_t ishard) final;
+    std::vector<NamedFunc> GetFunctions() const final;
 
     std::vector<double> sumw_, sumw2_;
 
@@ -32,8 +37,23 @@ public:
     TableColumn(TableColumn &&) = delete;
     TableColumn& operator=(TableColumn &&) = delete;
 
-    std::vector<NamedFunc> proc_and_table_cut_;
-    NamedFunc::VectorType cut_vector_, wgt_vector_, val_vector_;
+    //!Partial yields accumulated while processing a single entry range
+    class Shard{
+    public:
+      explicit Shard(std::size_t num_rows);
+
+      std::vector<double> sumw_, sumw2_;
+      NamedFunc::VectorType cut_vector_, wgt_vector_;
+      NamedFunc::VectorType prev_cut_vector_;//!<Per-object results of the previous data row
+    };
+
+    void FindNestedRows();
+
+    std::vector<NamedFunc> table_cut_;
+    std::vector<NamedFunc> increment_cut_;//!<Condition each row adds to the previous data row
+    std::vector<bool> implies_previous_;//!<Whether passing each row requires passing the previous data row
+    std::vector<bool> is_incremental_;//!<Whether increment_cut_ is evaluated instead of table_cut_
+    std::vector<std::unique_ptr<Shard> > shards_;//!<Partial yields, one for each entry range
   };
 
   Table(const std::string &name,
@@ -72,10 +92,12 @@ public:
   double tot_factor_;
   double precision_;
   std::vector<PlotOpt> plot_options_;//!<Styles with which to draw pie chart
+  bool cutflow_;//!<Whether each data row is declared to imply the previous one
 
   Table & TotColumn(const std::string &title, const double &factor=1.);
   Table & Precision(const double &precision);
   Table & Tag(const std::string &tag);
+  Table & Cutflow(bool cutflow = true);
   
 private:
   std::vector<std::unique_ptr<TableColumn> > backgrounds_;//!<Background components of the figure
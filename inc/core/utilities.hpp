@@ -37,8 +37,12 @@ std::string LeftStrip(std::string str);
 std::string RightStrip(std::string str);
 std::string Strip(std::string str);
 std::string ChangeExtension(std::string path, const std::string &new_ext);
+std::size_t EditDistance(const std::string &a, const std::string &b);
+std::string HashString(const std::string &text);
 
 bool FileExists(const std::string &path);
+std::string CanonicalPath(const std::string &path);
+bool FileStatus(const std::string &path, long &size, long &mtime);
 
 std::string execute(const std::string &cmd);
 
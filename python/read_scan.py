@@ -0,0 +1,74 @@
+#! /usr/bin/env python
+
+from __future__ import print_function
+
+import argparse
+import collections
+import os
+
+import numpy
+
+DTYPES = {"double": numpy.float64, "int64_t": numpy.int64}
+
+def FullPath(path):
+    return os.path.abspath(os.path.expanduser(path))
+
+def ReadManifest(scan_dir):
+    """Returns the number of entries and a list of (file, type, NamedFunc name) for each column"""
+    num_entries = None
+    columns = []
+    with open(os.path.join(scan_dir, "manifest.txt")) as manifest:
+        for line in manifest:
+            words = line.rstrip("\n").split(" ", 3)
+            if words[0] == "entries":
+                num_entries = int(words[1])
+            elif words[0] == "column" and len(words) == 4:
+                columns.append((words[1], words[2], words[3]))
+    if num_entries is None:
+        raise IOError("No entry count in manifest of "+scan_dir)
+    return num_entries, columns
+
+def ReadScan(scan_dir, names=None):
+    """Loads the columns of a binary EventScan into numpy arrays
+
+    Returns an ordered dict keyed by NamedFunc name (plus "row" and "instance").
+    Values are memory mapped, so only the columns that are used are read.
+    Missing values of vector columns shorter than the others are NaN.
+    """
+    scan_dir = FullPath(scan_dir)
+    num_entries, columns = ReadManifest(scan_dir)
+    arrays = collections.OrderedDict()
+    for file_name, type_name, name in columns:
+        if names is not None and name not in names and name not in ("row", "instance"):
+            continue
+        path = os.path.join(scan_dir, file_name+".col")
+        dtype = numpy.dtype(DTYPES[type_name])
+        if os.path.getsize(path) != num_entries*dtype.itemsize:
+            raise IOError("Unexpected size of "+path)
+        if num_entries == 0:
+            arrays[name] = numpy.zeros(0, dtype=dtype)
+        else:
+            arrays[name] = numpy.memmap(path, dtype=dtype, mode="r", shape=(num_entries,))
+    return arrays
+
+def PrintScan(arrays, num_rows, width):
+    print(" ".join(name[:width].rjust(width) for name in arrays))
+    for irow in range(num_rows):
+        print(" ".join(str(array[irow]).rjust(width) for array in arrays.values()))
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Prints the first lines of binary EventScan outputs",
+                                     formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument("scan_dir", nargs="+", metavar="SCAN_DIR",
+                        help="Directories written by EventScan::Binary(), eg tables/eventscan_SCAN_data")
+    parser.add_argument("-n", "--num_rows", type=int, default=10,
+                        help="Number of lines to print")
+    parser.add_argument("-w", "--width", type=int, default=16,
+                        help="Width of each printed column")
+    args = parser.parse_args()
+
+    for d in args.scan_dir:
+        arrays = ReadScan(d)
+        num_entries = len(next(iter(arrays.values()))) if arrays else 0
+        print(d+": "+str(num_entries)+" lines, "+str(len(arrays))+" columns")
+        PrintScan(arrays, min(args.num_rows, num_entries), args.width)
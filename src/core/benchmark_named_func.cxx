@@ -0,0 +1,153 @@
+// Measures the time per event needed to evaluate typical cut strings with the
+// closure and Bytecode versions of NamedFunc
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "TError.h" // Controls error level reporting
+
+#include "core/utilities.hpp"
+#include "core/baby.hpp"
+#include "core/baby_run2_std.hpp"
+#include "core/named_func.hpp"
+
+using namespace std;
+
+namespace{
+  string file_name = "ntuples/0.9.6-2016_production/Dst_D0-std/Dst--23_11_06--std--data--2016--md.root";
+  long max_entries = 200000;
+}
+
+void GetOptions(int argc, char *argv[]);
+
+/*!\brief Time evaluation of func on the first num_entries entries of baby
+
+  \param[in,out] baby Activated Baby to loop over
+
+  \param[in] func NamedFunc to evaluate once per event
+
+  \param[in] num_entries Number of entries to loop over
+
+  \param[out] num_pass Number of entries passing func
+
+  \return Average time per event in ns, including Baby::GetEntry
+*/
+double TimeEvaluation(Baby &baby, const NamedFunc &func, long num_entries, long &num_pass){
+  num_pass = 0;
+  auto start = chrono::steady_clock::now();
+  for(long entry = 0; entry < num_entries; ++entry){
+    baby.GetEntry(entry);
+    if(func.IsScalar()){
+      if(func.GetScalar(baby)) ++num_pass;
+    }else{
+      if(HavePass(func.GetVector(baby))) ++num_pass;
+    }
+  }
+  chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+  return num_entries > 0 ? elapsed.count()/num_entries : 0.;
+}
+
+int main(int argc, char *argv[]){
+  gErrorIgnoreLevel=6000; // Turns off ROOT errors due to missing branches
+  GetOptions(argc, argv);
+
+  vector<string> cuts = {
+    "mm2<0.5",
+    "q2>10.25 && el>1.5",
+    "(k_p < 200) && (pi_p < 200) && (mu_p < 100) && (iso_p1 < 200) && (iso_p2 < 200) && (iso_p3 < 200) && (nspdhits < 450)",
+    "(k_p < 200) && (pi_p < 200) && (mu_p < 100) && (iso_p1 < 200) && (iso_p2 < 200) && (iso_p3 < 200) && (nspdhits < 450) && is_dd && mu_ubdt_ok",
+    "1000*el/(mu_p*mu_p+1) > 0.01 || -mm2 > 2*q2 - 3",
+    "mu_pt > 1.2 && mu_eta > 1.7 && mu_eta < 5 && k_pt*pi_pt > 0.5"
+  };
+
+  Baby_run2_std baby(set<string>{file_name});
+  auto activator = baby.Activate();
+  long num_entries = baby.GetEntries();
+  if(max_entries >= 0 && num_entries > max_entries) num_entries = max_entries;
+  cout << "Timing " << num_entries << " entries of " << file_name << endl << endl;
+
+  vector<NamedFunc> closures, programs;
+  NamedFunc::UseBytecode(false);
+  for(const auto &cut: cuts) closures.push_back(NamedFunc(cut));
+  NamedFunc::UseBytecode(true);
+  for(const auto &cut: cuts) programs.push_back(NamedFunc(cut));
+  NamedFunc::UseBytecode(false);
+
+  //Load all baskets once so that both versions read from memory
+  long num_pass = 0;
+  for(const auto &cut: closures) TimeEvaluation(baby, cut, num_entries, num_pass);
+
+  cout << setw(12) << "Closure [ns]" << setw(13) << "Bytecode [ns]"
+       << setw(8) << "Ratio" << setw(8) << "Instr." << setw(10) << "Pass" << "  Cut" << endl;
+  for(size_t icut = 0; icut < cuts.size(); ++icut){
+    long closure_pass = 0, program_pass = 0;
+    double closure_ns = TimeEvaluation(baby, closures.at(icut), num_entries, closure_pass);
+    double program_ns = TimeEvaluation(baby, programs.at(icut), num_entries, program_pass);
+    if(closure_pass != program_pass){
+      ERROR("Closure and Bytecode disagree on "+cuts.at(icut)+": "
+            +to_string(closure_pass)+" vs "+to_string(program_pass)+" passing events");
+    }
+    size_t num_instructions = programs.at(icut).Code() ? programs.at(icut).Code()->NumInstructions() : 0;
+    cout << fixed << setprecision(1)
+         << setw(12) << closure_ns << setw(13) << program_ns
+         << setprecision(2) << setw(8) << (program_ns > 0. ? closure_ns/program_ns : 0.)
+         << setw(8) << num_instructions << setw(10) << closure_pass << "  " << cuts.at(icut) << endl;
+  }
+  cout << endl << "Times include Baby::GetEntry and reading the branches." << endl << endl;
+
+  // The adaptive version of globalCuts must not be replaced by the plain chain
+  // with the same terms built above, so it has to print its new order
+  const string &global_cuts = cuts.at(2);
+  long num_sampled = min(num_entries, 1000L);
+  if(num_sampled <= 0) return 0;
+  NamedFunc::AdaptiveLogic(num_sampled);
+  NamedFunc adaptive(global_cuts);
+  ostringstream report;
+  streambuf *cout_buffer = cout.rdbuf(report.rdbuf());
+  long closure_pass = 0, adaptive_pass = 0;
+  TimeEvaluation(baby, closures.at(2), num_entries, closure_pass);
+  double adaptive_ns = TimeEvaluation(baby, adaptive, num_entries, adaptive_pass);
+  cout.rdbuf(cout_buffer);
+  NamedFunc::AdaptiveLogic(0);
+  if(!Contains(report.str(), "Reordered")) ERROR("Adaptive chain was not reordered: "+global_cuts);
+  if(closure_pass != adaptive_pass){
+    ERROR("Closure and adaptive chain disagree on "+global_cuts+": "
+          +to_string(closure_pass)+" vs "+to_string(adaptive_pass)+" passing events");
+  }
+  cout << report.str() << fixed << setprecision(1) << "Adaptive chain: " << adaptive_ns << " ns" << endl << endl;
+}
+
+void GetOptions(int argc, char *argv[]){
+  while(true){
+    static struct option long_options[] = {
+      {"file", required_argument, 0, 'f'},    // Ntuple to loop over
+      {"entries", required_argument, 0, 'n'}, // Maximum number of entries, -1 for all
+      {0, 0, 0, 0}
+    };
+
+    char opt = -1;
+    int option_index;
+    opt = getopt_long(argc, argv, "f:n:", long_options, &option_index);
+    if(opt == -1) break;
+
+    switch(opt){
+    case 'f':
+      file_name = optarg;
+      break;
+    case 'n':
+      max_entries = atol(optarg);
+      break;
+    default:
+      printf("Bad option! getopt_long returned character code 0%o\n", opt);
+      break;
+    }
+  }
+}
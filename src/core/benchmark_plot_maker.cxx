@@ -0,0 +1,116 @@
+// Measures the event rate of PlotMaker with one thread and with all threads,
+// to compare the reading path at different commits on the same ntuple
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "TError.h" // Controls error level reporting
+
+#include "core/utilities.hpp"
+#include "core/baby.hpp"
+#include "core/baby_run2_std.hpp"
+#include "core/process.hpp"
+#include "core/named_func.hpp"
+#include "core/plot_maker.hpp"
+#include "core/palette.hpp"
+#include "core/hist1d.hpp"
+#include "core/plot_opt.hpp"
+
+using namespace std;
+
+namespace{
+  string file_name = "ntuples/0.9.6-2016_production/Dst_D0-std/Dst--23_11_06--std--data--2016--md.root";
+  int num_passes = 2;
+}
+
+void GetOptions(int argc, char *argv[]);
+
+/*!\brief Time one PlotMaker pass over the ntuple
+
+  \param[in] procs Processes reading the ntuple
+
+  \param[in] multithreaded Whether PlotMaker uses all hardware threads
+
+  \return Wall time of MakePlots in seconds
+*/
+double TimePass(const vector<shared_ptr<Process> > &procs, bool multithreaded){
+  vector<PlotOpt> plottypes = {PlotOpt("txt/plot_styles.txt", "LHCbPaper")};
+  PlotMaker pm;
+  pm.multithreaded_ = multithreaded;
+  pm.min_print_ = true;
+  pm.Push<Hist1D>(Axis(40, -2, 10, "mm2", "m_{miss}^{2} [GeV^{2}]"), "1", procs, plottypes).Tag("benchmark");
+  pm.Push<Hist1D>(Axis(40, -2, 12, "q2", "q^{2} [GeV^{2}]"), "is_dd", procs, plottypes).Tag("benchmark");
+  pm.Push<Hist1D>(Axis(40, 0, 3, "el", "E_{#mu} [GeV]"), "mu_ubdt_ok", procs, plottypes).Tag("benchmark");
+  auto start = chrono::steady_clock::now();
+  pm.MakePlots(1);
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]){
+  gErrorIgnoreLevel=6000; // Turns off ROOT errors due to missing branches
+  GetOptions(argc, argv);
+
+  Palette colors("txt/colors.txt", "default");
+  string globalCuts = "(k_p < 200) && (pi_p < 200) && (mu_p < 100) && (iso_p1 < 200) && (iso_p2 < 200) && (iso_p3 < 200) && (nspdhits < 450)";
+  vector<shared_ptr<Process> > procs;
+  procs.push_back(Process::MakeShared<Baby_run2_std>("benchmark", Process::Type::background, colors("data"),
+                                                     set<string>({file_name}), globalCuts));
+
+  long num_entries = 0;
+  {
+    Baby_run2_std baby(set<string>{file_name});
+    auto activator = baby.Activate();
+    num_entries = baby.GetEntries();
+  }
+
+  // The first pass of each mode also warms the page cache, so only the last
+  // one is reported
+  vector<pair<string, double> > results;
+  for(bool multithreaded: {false, true}){
+    double seconds = 0.;
+    for(int ipass = 0; ipass < num_passes; ++ipass) seconds = TimePass(procs, multithreaded);
+    results.emplace_back(multithreaded ? "all threads" : "1 thread", seconds);
+  }
+
+  cout << endl << AddCommas(num_entries) << " entries of " << file_name << endl;
+  for(const auto &result: results){
+    cout << setw(12) << result.first << ": " << setw(8) << RoundNumber(result.second, 2) << " s = "
+         << setw(8) << RoundNumber(num_entries/1000., 1, result.second) << " kHz" << endl;
+  }
+  cout << endl;
+}
+
+void GetOptions(int argc, char *argv[]){
+  while(true){
+    static struct option long_options[] = {
+      {"file", required_argument, 0, 'f'},   // run2_std ntuple to loop over
+      {"passes", required_argument, 0, 'p'}, // Passes per mode, the last one is reported
+      {0, 0, 0, 0}
+    };
+
+    char opt = -1;
+    int option_index;
+    opt = getopt_long(argc, argv, "f:p:", long_options, &option_index);
+    if(opt == -1) break;
+
+    switch(opt){
+    case 'f':
+      file_name = optarg;
+      break;
+    case 'p':
+      num_passes = max(atoi(optarg), 1);
+      break;
+    default:
+      printf("Bad option! getopt_long returned character code 0%o\n", opt);
+      break;
+    }
+  }
+}
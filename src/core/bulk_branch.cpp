@@ -0,0 +1,76 @@
+/*! \class BulkBranch
+
+  \brief Whole basket of a fixed-size numeric branch, read at once
+
+  Reading one entry of one branch with TBranch::GetEntry goes through a
+  virtual call and a basket lookup every time. When Baby::CacheOptions::bulk_read_
+  is enabled, the generated accessors of double, float, int32_t, and bool
+  variables instead use ROOT's bulk I/O to deserialize the full basket holding
+  the requested entry into a contiguous array, and copy later entries straight
+  from it until the basket is exhausted.
+
+  Branches that ROOT cannot read in bulk are detected on the first attempt, and
+  their accessors fall back to TBranch::GetEntry.
+*/
+#include "core/bulk_branch.hpp"
+
+#include <algorithm>
+
+#include "TBranch.h"
+#include "TBufferFile.h"
+
+using namespace std;
+
+/*!\brief Standard constructor. No memory is allocated until the first read.
+*/
+BulkBranch::BulkBranch():
+  buffer_(),
+  first_entry_(0),
+  end_entry_(0),
+  supported_(true){
+}
+
+BulkBranch::BulkBranch(BulkBranch &&) = default;
+BulkBranch & BulkBranch::operator=(BulkBranch &&) = default;
+BulkBranch::~BulkBranch() = default;
+
+/*!\brief Find serialized value of an entry, reading its basket if needed
+
+  \param[in] branch Branch of a fixed-size numeric variable
+
+  \param[in] tree_offset First chain entry of the tree owning branch
+
+  \param[in] entry Entry number within the tree
+
+  \param[in] size Size in bytes of each value
+
+  \return Pointer to the value, or nullptr if the branch cannot be read in
+  bulk
+*/
+const char * BulkBranch::Find(TBranch *branch, long tree_offset, long entry, size_t size){
+  long chain_entry = tree_offset + entry;
+  if(chain_entry < first_entry_ || chain_entry >= end_entry_){
+    if(!supported_) return nullptr;
+    if(!buffer_) buffer_.reset(new TBufferFile(TBuffer::kWrite, 10000));
+
+    //Bulk reads have to start at the first entry of a basket
+    const Long64_t *basket_entries = branch->GetBasketEntry();
+    const Long64_t *basket_end = basket_entries + branch->GetWriteBasket() + 1;
+    const Long64_t *basket = upper_bound(basket_entries, basket_end, static_cast<Long64_t>(entry));
+    if(basket == basket_entries){
+      supported_ = false;
+      return nullptr;
+    }
+    long first = *(basket-1);
+    Int_t num_entries = branch->GetBulkRead().GetBulkEntries(first, *buffer_);
+    if(num_entries <= 0 || entry >= first + num_entries){
+      supported_ = false;
+      first_entry_ = 0;
+      end_entry_ = 0;
+      return nullptr;
+    }
+    first_entry_ = tree_offset + first;
+    end_entry_ = first_entry_ + num_entries;
+  }
+  return buffer_->GetCurrent() + (chain_entry - first_entry_)*size;
+}
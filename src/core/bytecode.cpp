@@ -0,0 +1,505 @@
+/*! \class Bytecode
+
+  \brief Flat, interpreted representation of a NamedFunc
+
+  A NamedFunc built with FunctionParser or the NamedFunc operators is normally
+  evaluated through a tree of nested closures, each costing an indirect call
+  and, for vector operands, a freshly allocated vector. Bytecode represents the
+  same expression as a flat list of instructions acting on a stack of scalars
+  and a stack of vectors, which is run by a single loop in Bytecode::Run().
+
+  Each Bytecode is built from the Bytecode of its operands, mirroring the
+  corresponding NamedFunc operator. Operands are shared rather than copied, so
+  building an expression costs the same whether or not NamedFunc::UseBytecode()
+  is enabled. The flat program is only emitted from this tree the first time an
+  expression is run. Constants are pushed directly, while Baby
+  variables and custom functions are called through their std::function. The
+  short-circuiting of "&&" and "||" is preserved with jumps, so expressions like
+  "nmu>0 && mu_pt[0]>1" remain safe.
+
+  The stacks are kept per thread and reused across events, so no memory is
+  allocated in the loop except for the vectors returned by called functions.
+*/
+#include "core/bytecode.hpp"
+
+#include <cmath>
+#include <deque>
+#include <algorithm>
+
+#include "core/utilities.hpp"
+
+using namespace std;
+
+using ScalarType = Bytecode::ScalarType;
+using VectorType = Bytecode::VectorType;
+using ScalarFunc = Bytecode::ScalarFunc;
+using VectorFunc = Bytecode::VectorFunc;
+using Pointer = Bytecode::Pointer;
+using Operator = Bytecode::Operator;
+
+namespace{
+  /*!\brief Apply binary operator op to x and y
+
+    \param[in] op Operator to apply. Must not be Operator::subscript.
+
+    \param[in] x Left hand operand
+
+    \param[in] y Right hand operand
+
+    \return Result of x op y
+  */
+  inline ScalarType Evaluate(Operator op, ScalarType x, ScalarType y){
+    switch(op){
+    case Operator::plus: return x+y;
+    case Operator::minus: return x-y;
+    case Operator::multiplies: return x*y;
+    case Operator::divides: return x/y;
+    case Operator::modulus: return fmod(x, y);
+    case Operator::equal: return x==y;
+    case Operator::not_equal: return x!=y;
+    case Operator::greater: return x>y;
+    case Operator::less: return x<y;
+    case Operator::greater_equal: return x>=y;
+    case Operator::less_equal: return x<=y;
+    case Operator::logical_and: return x&&y;
+    case Operator::logical_or: return x||y;
+    case Operator::subscript:
+    default:
+      ERROR("Cannot apply operator "+to_string(static_cast<int>(op))+" to two numbers");
+    }
+  }
+}
+
+/*!\brief Stacks used while running a Bytecode
+*/
+struct Bytecode::Frame{
+  vector<ScalarType> scalars_;//!<Scalar stack
+  vector<VectorType> vectors_;//!<Vector stack
+};
+
+/*!\brief Borrows a Frame for the lifetime of the guard
+
+  Frames are kept per thread and reused. Called functions may themselves run a
+  Bytecode, so each nesting level gets its own Frame.
+*/
+class Bytecode::FrameGuard{
+public:
+  FrameGuard():
+    frame_(nullptr){
+    if(level_ == frames_.size()) frames_.emplace_back();
+    frame_ = &frames_[level_++];
+  }
+
+  ~FrameGuard(){
+    --level_;
+  }
+
+  Frame & GetFrame(){
+    return *frame_;
+  }
+
+private:
+  FrameGuard(const FrameGuard &) = delete;
+  FrameGuard & operator=(const FrameGuard &) = delete;
+
+  static thread_local deque<Frame> frames_;//!<Frames of this thread. Deque keeps references valid when growing.
+  static thread_local size_t level_;//!<Number of frames currently in use by this thread
+  Frame *frame_;//!<Frame borrowed by this guard
+};
+
+thread_local deque<Bytecode::Frame> Bytecode::FrameGuard::frames_;
+thread_local size_t Bytecode::FrameGuard::level_ = 0;
+
+/*!\brief Get Bytecode pushing a constant
+
+  \param[in] x Value of the constant
+
+  \return Bytecode returning x
+*/
+Pointer Bytecode::Constant(ScalarType x){
+  shared_ptr<Bytecode> result(new Bytecode());
+  result->program_.Push(OpCode::constant, Operator::plus, 0, x);
+  result->num_instructions_ = 1;
+  result->scalar_depth_ = 1;
+  result->is_scalar_ = true;
+  return result;
+}
+
+/*!\brief Get Bytecode calling a scalar function
+
+  \param[in] function Function taking a Baby and returning a scalar
+
+  \return Bytecode returning the result of function, or null if function is
+  invalid
+*/
+Pointer Bytecode::Call(const function<ScalarFunc> &function){
+  if(!static_cast<bool>(function)) return Pointer();
+  shared_ptr<Bytecode> result(new Bytecode());
+  result->program_.scalar_calls_.push_back(function);
+  result->program_.Push(OpCode::call_scalar);
+  result->num_instructions_ = 1;
+  result->scalar_depth_ = 1;
+  result->is_scalar_ = true;
+  return result;
+}
+
+/*!\brief Get Bytecode calling a vector function
+
+  \param[in] function Function taking a Baby and returning a vector
+
+  \return Bytecode returning the result of function, or null if function is
+  invalid
+*/
+Pointer Bytecode::Call(const function<VectorFunc> &function){
+  if(!static_cast<bool>(function)) return Pointer();
+  shared_ptr<Bytecode> result(new Bytecode());
+  result->program_.vector_calls_.push_back(function);
+  result->program_.Push(OpCode::call_vector);
+  result->num_instructions_ = 1;
+  result->vector_depth_ = 1;
+  result->is_scalar_ = false;
+  return result;
+}
+
+/*!\brief Get Bytecode applying a unary operator
+
+  \param[in] op Operator to apply
+
+  \param[in] a Operand
+
+  \return Bytecode returning op applied to the result of a, or null if a is null
+*/
+Pointer Bytecode::Apply(UnaryOperator op, const Pointer &a){
+  if(!a) return Pointer();
+  if(op != UnaryOperator::negate && op != UnaryOperator::logical_not){
+    ERROR("Unknown unary operator "+to_string(static_cast<int>(op)));
+  }
+  shared_ptr<Bytecode> result(new Bytecode());
+  result->lhs_ = a;
+  result->unary_op_ = op;
+  result->num_instructions_ = a->num_instructions_+1;
+  result->scalar_depth_ = a->scalar_depth_;
+  result->vector_depth_ = a->vector_depth_;
+  result->is_scalar_ = a->is_scalar_;
+  return result;
+}
+
+/*!\brief Get Bytecode applying a binary operator
+
+  Scalar/vector combinations follow the same rules as the NamedFunc operators.
+
+  \param[in] op Operator to apply
+
+  \param[in] a Left hand operand
+
+  \param[in] b Right hand operand
+
+  \return Bytecode returning the result of a op b, or null if either operand is
+  null or the operation is invalid
+*/
+Pointer Bytecode::Apply(Operator op, const Pointer &a, const Pointer &b){
+  if(!a || !b) return Pointer();
+  if(op == Operator::subscript && (a->is_scalar_ || !b->is_scalar_)) return Pointer();
+
+  shared_ptr<Bytecode> result(new Bytecode());
+  result->lhs_ = a;
+  result->rhs_ = b;
+  result->op_ = op;
+  bool is_logical = op == Operator::logical_and || op == Operator::logical_or;
+  bool has_jump = is_logical && b->is_scalar_;
+  result->num_instructions_ = a->num_instructions_ + b->num_instructions_ + (has_jump ? 2 : 1);
+  result->scalar_depth_ = max(a->scalar_depth_, b->scalar_depth_ + (a->is_scalar_ ? 1 : 0));
+  result->vector_depth_ = max(a->vector_depth_, b->vector_depth_ + (a->is_scalar_ ? 0 : 1));
+  result->is_scalar_ = op == Operator::subscript || (a->is_scalar_ && b->is_scalar_);
+  return result;
+}
+
+/*!\brief Check if result is a scalar
+
+  \return True if the result is a scalar; false if it is a vector
+*/
+bool Bytecode::IsScalar() const{
+  return is_scalar_;
+}
+
+/*!\brief Check if result is a vector
+
+  \return True if the result is a vector; false if it is a scalar
+*/
+bool Bytecode::IsVector() const{
+  return !is_scalar_;
+}
+
+/*!\brief Get number of instructions
+
+  \return Number of instructions executed in the worst case
+*/
+size_t Bytecode::NumInstructions() const{
+  return num_instructions_;
+}
+
+/*!\brief Check if the expression is a binary operation with operator op at the
+  top level
+
+  \param[in] op Operator to look for
+
+  \return True if this Bytecode was built by Apply(op, a, b)
+*/
+bool Bytecode::Applies(Operator op) const{
+  return rhs_ != nullptr && op_ == op;
+}
+
+/*!\brief Get the left hand operand of a binary operation
+
+  \return Bytecode of the operand, or null for constants and calls
+*/
+const Pointer & Bytecode::LeftOperand() const{
+  return lhs_;
+}
+
+/*!\brief Get the right hand operand of a binary operation
+
+  \return Bytecode of the operand, or null if this is not a binary operation
+*/
+const Pointer & Bytecode::RightOperand() const{
+  return rhs_;
+}
+
+/*!\brief Run scalar Bytecode
+
+  \param[in] b Baby to evaluate on
+
+  \return Result of the expression
+*/
+ScalarType Bytecode::GetScalar(const Baby &b) const{
+  FrameGuard guard;
+  Frame &frame = guard.GetFrame();
+  Run(b, frame);
+  return frame.scalars_[0];
+}
+
+/*!\brief Run vector Bytecode
+
+  \param[in] b Baby to evaluate on
+
+  \return Result of the expression
+*/
+VectorType Bytecode::GetVector(const Baby &b) const{
+  FrameGuard guard;
+  Frame &frame = guard.GetFrame();
+  Run(b, frame);
+  return frame.vectors_[0];
+}
+
+/*!\brief Empty program, only used internally before setting the operands or
+  pushing instructions
+*/
+Bytecode::Bytecode():
+  lhs_(),
+  rhs_(),
+  op_(Operator::plus),
+  unary_op_(UnaryOperator::negate),
+  num_instructions_(0),
+  scalar_depth_(0),
+  vector_depth_(0),
+  is_scalar_(true),
+  program_(),
+  flatten_once_(){
+}
+
+/*!\brief Append the flat program of this expression
+
+  \param[in,out] program Program to which the instructions are appended
+*/
+void Bytecode::Emit(Program &program) const{
+  if(!lhs_){
+    program.Append(program_);
+    return;
+  }
+  const Bytecode &a = *lhs_;
+  a.Emit(program);
+  if(!rhs_){
+    if(unary_op_ == UnaryOperator::negate){
+      program.Push(a.is_scalar_ ? OpCode::negate_scalar : OpCode::negate_vector);
+    }else{
+      program.Push(a.is_scalar_ ? OpCode::not_scalar : OpCode::not_vector);
+    }
+    return;
+  }
+
+  const Bytecode &b = *rhs_;
+  Operator op = op_;
+  bool is_logical = op == Operator::logical_and || op == Operator::logical_or;
+  if(is_logical && a.is_scalar_ && b.is_scalar_){
+    program.Push(op == Operator::logical_and ? OpCode::jump_if_false : OpCode::jump_if_true,
+                 op, b.num_instructions_+1);
+    b.Emit(program);
+    program.Push(OpCode::to_bool);
+  }else if(is_logical && !a.is_scalar_ && b.is_scalar_){
+    program.Push(op == Operator::logical_and ? OpCode::skip_if_none : OpCode::skip_if_all,
+                 op, b.num_instructions_);
+    b.Emit(program);
+    program.Push(OpCode::binary_vs, op);
+  }else{
+    b.Emit(program);
+    if(op == Operator::subscript) program.Push(OpCode::subscript);
+    else if(a.is_scalar_ && b.is_scalar_) program.Push(OpCode::binary_ss, op);
+    else if(a.is_scalar_) program.Push(OpCode::binary_sv, op);
+    else if(b.is_scalar_) program.Push(OpCode::binary_vs, op);
+    else program.Push(OpCode::binary_vv, op);
+  }
+}
+
+/*!\brief Get the flat program, emitting it on the first call
+
+  \return Instructions and called functions of the whole expression
+*/
+const Bytecode::Program & Bytecode::GetProgram() const{
+  call_once(flatten_once_, [this](){
+      if(lhs_) Emit(program_);
+    });
+  return program_;
+}
+
+/*!\brief Append instructions and called functions of another program
+
+  \param[in] other Program whose instructions are executed after the current
+  ones
+*/
+void Bytecode::Program::Append(const Program &other){
+  size_t scalar_offset = scalar_calls_.size();
+  size_t vector_offset = vector_calls_.size();
+  scalar_calls_.insert(scalar_calls_.end(), other.scalar_calls_.cbegin(), other.scalar_calls_.cend());
+  vector_calls_.insert(vector_calls_.end(), other.vector_calls_.cbegin(), other.vector_calls_.cend());
+  for(Instruction instruction: other.code_){
+    if(instruction.code_ == OpCode::call_scalar) instruction.arg_ += scalar_offset;
+    else if(instruction.code_ == OpCode::call_vector) instruction.arg_ += vector_offset;
+    code_.push_back(instruction);
+  }
+}
+
+/*!\brief Append an instruction
+
+  \param[in] code Operation to perform
+
+  \param[in] op Operator for the binary_* operations
+
+  \param[in] arg Index of function to call or number of instructions to skip
+
+  \param[in] value Value of constant
+*/
+void Bytecode::Program::Push(OpCode code, Operator op, size_t arg, ScalarType value){
+  code_.push_back(Instruction{code, op, arg, value});
+}
+
+/*!\brief Execute all instructions, leaving the result at the bottom of the
+  corresponding stack
+
+  \param[in] b Baby to evaluate on
+
+  \param[in,out] frame Stacks to use
+*/
+void Bytecode::Run(const Baby &b, Frame &frame) const{
+  if(frame.scalars_.size() < scalar_depth_) frame.scalars_.resize(scalar_depth_);
+  if(frame.vectors_.size() < vector_depth_) frame.vectors_.resize(vector_depth_);
+  ScalarType *s = frame.scalars_.data();
+  VectorType *v = frame.vectors_.data();
+  size_t ns = 0, nv = 0;
+  const Program &program = GetProgram();
+  const vector<Instruction> &code = program.code_;
+
+  for(size_t pc = 0; pc < code.size(); ++pc){
+    const Instruction &ins = code[pc];
+    switch(ins.code_){
+    case OpCode::constant:
+      s[ns++] = ins.value_;
+      break;
+    case OpCode::call_scalar:
+      s[ns++] = program.scalar_calls_[ins.arg_](b);
+      break;
+    case OpCode::call_vector:
+      v[nv++] = program.vector_calls_[ins.arg_](b);
+      break;
+    case OpCode::negate_scalar:
+      s[ns-1] = -s[ns-1];
+      break;
+    case OpCode::negate_vector:
+      for(auto &x: v[nv-1]) x = -x;
+      break;
+    case OpCode::not_scalar:
+      s[ns-1] = !s[ns-1];
+      break;
+    case OpCode::not_vector:
+      for(auto &x: v[nv-1]) x = !x;
+      break;
+    case OpCode::binary_ss:
+      --ns;
+      s[ns-1] = Evaluate(ins.op_, s[ns-1], s[ns]);
+      break;
+    case OpCode::binary_sv:{
+      ScalarType sa = s[--ns];
+      VectorType &vb = v[nv-1];
+      if(ins.op_ == Operator::logical_and){
+        if(!sa) fill(vb.begin(), vb.end(), 0.);
+      }else if(ins.op_ == Operator::logical_or){
+        if(sa) fill(vb.begin(), vb.end(), 1.);
+      }else{
+        for(auto &x: vb) x = Evaluate(ins.op_, sa, x);
+      }
+      break;
+    }
+    case OpCode::binary_vs:{
+      ScalarType sb = s[--ns];
+      for(auto &x: v[nv-1]) x = Evaluate(ins.op_, x, sb);
+      break;
+    }
+    case OpCode::binary_vv:{
+      --nv;
+      VectorType &va = v[nv-1];
+      const VectorType &vb = v[nv];
+      if(vb.size() < va.size()) va.resize(vb.size());
+      for(size_t i = 0; i < va.size(); ++i){
+        va[i] = Evaluate(ins.op_, va[i], vb[i]);
+      }
+      break;
+    }
+    case OpCode::subscript:
+      --nv;
+      s[ns-1] = v[nv].at(s[ns-1]);
+      break;
+    case OpCode::jump_if_false:
+      if(!s[ns-1]){
+        s[ns-1] = 0.;
+        pc += ins.arg_;
+      }else{
+        --ns;
+      }
+      break;
+    case OpCode::jump_if_true:
+      if(s[ns-1]){
+        s[ns-1] = 1.;
+        pc += ins.arg_;
+      }else{
+        --ns;
+      }
+      break;
+    case OpCode::to_bool:
+      s[ns-1] = static_cast<bool>(s[ns-1]);
+      break;
+    case OpCode::skip_if_none:
+      if(none_of(v[nv-1].cbegin(), v[nv-1].cend(), [](ScalarType x){return static_cast<bool>(x);})){
+        s[ns++] = 0.;
+        pc += ins.arg_;
+      }
+      break;
+    case OpCode::skip_if_all:
+      if(all_of(v[nv-1].cbegin(), v[nv-1].cend(), [](ScalarType x){return static_cast<bool>(x);})){
+        s[ns++] = 0.;
+        pc += ins.arg_;
+      }
+      break;
+    default:
+      ERROR("Unknown op code "+to_string(static_cast<int>(ins.code_)));
+    }
+  }
+}
@@ -84,6 +84,64 @@ void Clusterizer::AddPoint(float x, float y, float w){
   }
 }
 
+/*!\brief Adds fills accumulated outside of the clusterizer
+
+  The histogram ends up as if the points had been added with AddPoint(). The
+  individual points are only needed while the total stays within MaxPoints().
+
+  \param[in] sumw Sum of weights in each global bin of the histogram
+
+  \param[in] sumw2 Sum of squared weights in each global bin
+
+  \param[in] stats In-range sums of w, w^2, wx, wx^2, wy, wy^2, and wxy, as
+  returned by TH2::GetStats()
+
+  \param[in] entries Number of fills
+
+  \param[in] points Filled points, in the order they were filled
+
+  \param[in] all_points Whether points holds every fill. Can be false if
+  there were more than MaxPoints() fills.
+*/
+void Clusterizer::AddBinned(const vector<double> &sumw,
+                            const vector<double> &sumw2,
+                            const array<double, 7> &stats,
+                            double entries,
+                            const vector<Point> &points,
+                            bool all_points){
+  if(entries == 0.) return;
+  clustered_lumi_ = -1.;
+  double hist_stats[TH1::kNstat];
+  hist_.GetStats(hist_stats);
+  TArrayD &hist_sumw2 = *hist_.GetSumw2();
+  for(int bin = 0; bin < hist_.GetNcells(); ++bin){
+    hist_.AddBinContent(bin, sumw.at(bin));
+    hist_sumw2[bin] += sumw2.at(bin);
+  }
+  for(size_t i = 0; i < stats.size(); ++i){
+    hist_stats[i] += stats[i];
+  }
+  hist_.PutStats(hist_stats);
+  hist_.SetEntries(hist_.GetEntries()+entries);
+
+  if(hist_mode_) return;
+  if(!all_points
+     || (max_points_ >= 0 && orig_points_.size()+points.size() > static_cast<size_t>(max_points_))){
+    hist_mode_ = true;
+    orig_points_.clear();
+  }else{
+    orig_points_.insert(orig_points_.end(), points.cbegin(), points.cend());
+  }
+}
+
+/*!\brief Get number of points above which only the histogram is kept
+
+  \return Maximum number of points, or a negative number if unlimited
+*/
+long Clusterizer::MaxPoints() const{
+  return max_points_;
+}
+
 void Clusterizer::SetPoints(const vector<Point> &points){
   clustered_lumi_ = -1.;
   EmptyHistogram();
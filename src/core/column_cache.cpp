@@ -0,0 +1,111 @@
+/*! \class ColumnCache
+
+  \brief Values of the branches of a Baby, kept in memory between passes over
+  its entries
+
+  When PlotMaker::column_cache_mb_ is positive, each Baby gets a ColumnCache
+  with one contiguous array for each double, float, int32_t, and bool branch
+  used by the figures, as long as the arrays of all Babies fit in the budget.
+  The generated accessors store every value they read from such a branch, and
+  return the stored value without touching the branch when the same entry is
+  read again. Later calls to PlotMaker::MakePlots, or other PlotMakers using the
+  same Processes, then serve those branches from memory instead of
+  decompressing their baskets again.
+
+  The cache is shared by a Baby and its clones. Since the clones process
+  disjoint entry ranges, they fill the columns without locking.
+*/
+#include "core/column_cache.hpp"
+
+using namespace std;
+
+atomic<size_t> ColumnCache::total_bytes_(0);
+
+/*!\brief Standard constructor
+
+  \param[in] num_entries Number of entries in the TChain of the Baby
+*/
+ColumnCache::ColumnCache(long num_entries):
+  num_entries_(num_entries),
+  columns_(),
+  bytes_(0){
+}
+
+/*!\brief Destructor. Returns the memory of the columns to the shared budget.
+*/
+ColumnCache::~ColumnCache(){
+  total_bytes_ -= bytes_;
+}
+
+/*!\brief Standard constructor
+
+  \param[in] num_entries Number of entries in the column
+*/
+ColumnCache::ColumnBase::ColumnBase(long num_entries):
+  num_entries_(num_entries),
+  filled_(new bool[static_cast<size_t>(num_entries)]()),
+  complete_(false){
+}
+
+/*!\brief Check whether the given entries have all been stored
+
+  Must not be called while the column is being filled.
+
+  \param[in] entries Sorted entries to check, or null to check every entry
+
+  \return True if no listed entry is missing
+*/
+bool ColumnCache::ColumnBase::IsFilled(const vector<long> *entries) const{
+  if(complete_) return true;
+  if(entries != nullptr){
+    for(const auto &entry: *entries){
+      if(!filled_[entry]) return false;
+    }
+    return true;
+  }
+  for(long entry = 0; entry < num_entries_; ++entry){
+    if(!filled_[entry]) return false;
+  }
+  complete_ = true;
+  return true;
+}
+
+/*!\brief Get branches whose values are already stored for the given entries
+
+  Accessors never read these branches, so they need not be enabled nor added
+  to the TTreeCache. Must not be called while the columns are being filled.
+
+  \param[in] entries Sorted entries that will be read, or null for every entry
+
+  \return Names of the filled branches
+*/
+set<string> ColumnCache::FilledColumns(const vector<long> *entries) const{
+  set<string> filled;
+  for(const auto &column: columns_){
+    if(column.second->IsFilled(entries)) filled.insert(column.first);
+  }
+  return filled;
+}
+
+/*!\brief Get memory held by the columns of all caches
+
+  \return Memory in MB
+*/
+double ColumnCache::MegabytesUsed(){
+  return total_bytes_/static_cast<double>(1 << 20);
+}
+
+/*!\brief Account for a new column, if it fits in the budget
+
+  \param[in] bytes Memory needed by the column
+
+  \param[in] max_megabytes Maximum memory used by the columns of all caches
+
+  \return True if the column fits
+*/
+bool ColumnCache::Reserve(size_t bytes, double max_megabytes){
+  if(total_bytes_+bytes > max_megabytes*(1 << 20)) return false;
+  total_bytes_ += bytes;
+  bytes_ += bytes;
+  return true;
+}
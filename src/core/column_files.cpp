@@ -0,0 +1,210 @@
+/*! \class ColumnFiles
+
+  \brief Uncompressed copies of the branches of an ntuple, read through mmap
+
+  make_columns.exe writes the double, float, int32_t, and bool branches of
+  ntuples into ColumnFiles::CacheDirectory(), one directory per ntuple named
+  after a hash of its absolute path. Each branch is a file holding the raw
+  values of all entries, and manifest.txt records the path, size, and
+  modification time of the ntuple, its number of entries, and the type of each
+  stored branch.
+
+  Every time a Baby opens an ntuple, it looks for a manifest matching the file
+  on disk. If found, the accessors of the stored branches read the values
+  straight from the mapped files, without touching the TTree, and the page
+  cache keeps them in memory across jobs. Rewriting the ntuple changes its size
+  or modification time, so stale columns are ignored until rebuilt.
+*/
+#include "core/column_files.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "core/utilities.hpp"
+
+using namespace std;
+
+namespace{
+  string cache_directory = "columns";//!<Location of the column directories
+}
+
+/*!\brief Read the manifest of the columns of an ntuple
+
+  Columns are mapped only when requested with Find().
+
+  \param[in] root_file Path to the ntuple
+*/
+ColumnFiles::ColumnFiles(const string &root_file):
+  root_file_(root_file),
+  num_entries_(-1),
+  types_(),
+  mappings_(){
+  ifstream manifest(Directory(root_file)+"/manifest.txt");
+  if(!manifest) return;
+  string source = "";
+  long size = -1, mtime = -1, entries = -1;
+  map<string, string> types;
+  string line;
+  while(getline(manifest, line)){
+    istringstream iss(line);
+    string key;
+    iss >> key;
+    if(key == "source"){
+      getline(iss >> ws, source);
+    }else if(key == "size"){
+      iss >> size;
+    }else if(key == "mtime"){
+      iss >> mtime;
+    }else if(key == "entries"){
+      iss >> entries;
+    }else if(key == "column"){
+      string branch, type;
+      iss >> branch >> type;
+      types[branch] = type;
+    }
+  }
+
+  long file_size = -1, file_mtime = -1;
+  if(!FileStatus(root_file, file_size, file_mtime)) return;
+  if(source != CanonicalPath(root_file) || size != file_size || mtime != file_mtime) return;
+  num_entries_ = entries;
+  types_ = types;
+}
+
+/*!\brief Destructor. Unmaps all columns.
+*/
+ColumnFiles::~ColumnFiles(){
+  for(const auto &mapping: mappings_){
+    munmap(mapping.second.first, mapping.second.second);
+  }
+}
+
+/*!\brief Get directory holding the column directories
+
+  \return Directory, relative to the working directory unless absolute
+*/
+const string & ColumnFiles::CacheDirectory(){
+  return cache_directory;
+}
+
+/*!\brief Set directory holding the column directories
+
+  Should point to fast local storage. Must be set before the Babies are
+  activated.
+
+  \param[in] directory Directory, relative to the working directory unless
+  absolute
+*/
+void ColumnFiles::CacheDirectory(const string &directory){
+  cache_directory = directory;
+}
+
+/*!\brief Get directory holding the columns of an ntuple
+
+  \param[in] root_file Path to the ntuple
+
+  \return Directory named after a hash of the absolute path of root_file
+*/
+string ColumnFiles::Directory(const string &root_file){
+  return cache_directory+"/"+HashString(CanonicalPath(root_file));
+}
+
+/*!\brief Get file holding the values of one branch of an ntuple
+
+  \param[in] root_file Path to the ntuple
+
+  \param[in] branch Name of the branch
+
+  \return Path to the column file
+*/
+string ColumnFiles::ColumnPath(const string &root_file, const string &branch){
+  return Directory(root_file)+"/"+branch+".col";
+}
+
+/*!\brief Write the manifest validating the columns of an ntuple
+
+  Must be called after all column files are written, with the ntuple unchanged
+  since they were read.
+
+  \param[in] root_file Path to the ntuple
+
+  \param[in] num_entries Number of entries in each column
+
+  \param[in] types Type of each stored branch, as in txt/variables
+*/
+void ColumnFiles::WriteManifest(const string &root_file, long num_entries,
+                                const map<string, string> &types){
+  long size = -1, mtime = -1;
+  if(!FileStatus(root_file, size, mtime)) ERROR("Could not find "+root_file);
+  string path = Directory(root_file)+"/manifest.txt";
+  ofstream manifest(path);
+  if(!manifest) ERROR("Could not write "+path);
+  manifest << "source " << CanonicalPath(root_file) << '\n'
+           << "size " << size << '\n'
+           << "mtime " << mtime << '\n'
+           << "entries " << num_entries << '\n';
+  for(const auto &type: types){
+    manifest << "column " << type.first << ' ' << type.second << '\n';
+  }
+}
+
+/*!\brief Check if the manifest matches the ntuple on disk
+
+  \return True if columns can be read
+*/
+bool ColumnFiles::IsValid() const{
+  return num_entries_ >= 0;
+}
+
+/*!\brief Get number of entries in each column
+
+  \return Number of entries, or -1 if the columns are not valid
+*/
+long ColumnFiles::NumEntries() const{
+  return num_entries_;
+}
+
+/*!\brief Map the column of a branch into memory
+
+  \param[in] branch Name of the branch
+
+  \param[in] type Type of the branch as in txt/variables
+
+  \param[in] size Size in bytes of each value
+
+  \return Address of the value of the first entry, or nullptr if the branch is
+  not stored with this type
+*/
+const void * ColumnFiles::Find(const string &branch, const string &type, size_t size){
+  auto mapped = mappings_.find(branch);
+  if(mapped != mappings_.cend()) return mapped->second.first;
+  auto found = types_.find(branch);
+  if(!IsValid() || num_entries_ == 0 || found == types_.cend() || found->second != type) return nullptr;
+
+  string path = ColumnPath(root_file_, branch);
+  size_t length = static_cast<size_t>(num_entries_)*size;
+  long file_size = -1, file_mtime = -1;
+  if(!FileStatus(path, file_size, file_mtime) || static_cast<size_t>(file_size) != length) return nullptr;
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) return nullptr;
+  void *data = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) return nullptr;
+  madvise(data, length, MADV_SEQUENTIAL);
+  mappings_[branch] = make_pair(data, length);
+  return data;
+}
+
+/*!\brief Check whether the column of a branch has been mapped by Find()
+
+  \param[in] branch Name of the branch
+
+  \return True if the accessors read the branch from its column file
+*/
+bool ColumnFiles::IsMapped(const string &branch) const{
+  return mappings_.find(branch) != mappings_.cend();
+}
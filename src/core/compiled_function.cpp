@@ -0,0 +1,101 @@
+/*! \class CompiledFunction
+
+  \brief Ahead-of-time compiled version of a NamedFunc string
+
+  When the code is built, generate_baby.exe collects the string literals in the
+  analysis scripts (and the lines in txt/compiled_functions.txt) that are valid
+  scalar expressions of Baby variables. For each of them and each Baby type
+  containing all of its variables, it writes a plain C++ function calling the
+  accessors of that Baby type directly into src/core/compiled_functions.cpp,
+  which also defines CompiledFunction::Registry().
+
+  NamedFunc looks up every string it parses with CompiledFunction::Find(), and
+  if found evaluates the compiled function instead of the closures built by
+  FunctionParser. The closures are kept for Baby types without a compiled
+  version. Expressions built at run time, e.g. by concatenating strings, can be
+  added to txt/compiled_functions.txt.
+
+  The implementations are stored in a table indexed by Baby::TypeNumber(), so
+  finding the one for the Baby being evaluated is a single load, without typeid
+  or a search.
+*/
+#include "core/compiled_function.hpp"
+
+#include <unordered_map>
+
+#include "core/baby.hpp"
+#include "core/utilities.hpp"
+
+using namespace std;
+
+/*!\brief Standard constructor, used by the generated registry
+
+  \param[in] expression Expression without spaces
+
+  \param[in] implementations Baby::TypeNumber() of each Baby type with a compiled
+  function, and the function
+*/
+CompiledFunction::CompiledFunction(const string &expression,
+                                   const vector<Implementation> &implementations):
+  expression_(expression),
+  functions_(Baby::num_types_, nullptr),
+  num_implementations_(implementations.size()){
+  for(const auto &implementation: implementations){
+    functions_.at(implementation.first) = implementation.second;
+  }
+}
+
+/*!\brief Find the compiled version of an expression
+
+  \param[in] expression String as given to NamedFunc. Spaces are ignored.
+
+  \return Pointer to compiled function, or nullptr if expression was not
+  compiled
+*/
+const CompiledFunction * CompiledFunction::Find(const string &expression){
+  static const unordered_map<string, const CompiledFunction *> index = [](){
+    unordered_map<string, const CompiledFunction *> result;
+    for(const auto &func: Registry()){
+      result[func.Expression()] = &func;
+    }
+    return result;
+  }();
+  auto found = index.find(CopyReplaceAll(expression, " ", ""));
+  return found == index.cend() ? nullptr : found->second;
+}
+
+/*!\brief Get expression implemented by this function
+
+  \return Expression without spaces
+*/
+const string & CompiledFunction::Expression() const{
+  return expression_;
+}
+
+/*!\brief Get number of Baby types for which this function was compiled
+
+  \return Number of Baby types with a compiled implementation
+*/
+size_t CompiledFunction::NumImplementations() const{
+  return num_implementations_;
+}
+
+/*!\brief Get compiled function for the type of b
+
+  \param[in] b Baby the function will be evaluated on
+
+  \return Compiled function, or nullptr if not available for this Baby type
+*/
+CompiledFunction::Pointer CompiledFunction::Get(const Baby &b) const{
+  return Get(b.TypeNumber());
+}
+
+/*!\brief Get compiled function for a Baby type
+
+  \param[in] type_number Baby::TypeNumber() of the Baby type
+
+  \return Compiled function, or nullptr if not available for this Baby type
+*/
+CompiledFunction::Pointer CompiledFunction::Get(size_t type_number) const{
+  return type_number < functions_.size() ? functions_[type_number] : nullptr;
+}
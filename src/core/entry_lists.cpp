@@ -0,0 +1,127 @@
+/*! \namespace EntryLists
+
+  \brief Entries of a Baby passing a Process cut, stored on disk between runs
+
+  With PlotMaker::use_entry_lists_, the entries passing each Process cut are
+  recorded the first time a Baby is processed, and written to
+  EntryLists::CacheDirectory() under a key hashing the cut and the path, size,
+  and modification time of every file of the Baby. Later runs with the same
+  files and cuts only load the union of the listed entries.
+
+  The key uses NamedFunc::Key() of the cut, derived from the expression for
+  NamedFuncs built from strings. Cuts built from lambdas have no key unless one
+  is set with NamedFunc::Key(), so no list is recorded for their Babies. A key
+  set by hand must change whenever the code of the lambda does.
+*/
+#include "core/entry_lists.hpp"
+
+#include <cstdio>
+
+#include <fstream>
+
+#include "TSystem.h"
+
+#include "core/utilities.hpp"
+
+using namespace std;
+
+namespace{
+  string cache_directory = "entry_lists";//!<Location of the entry list files
+
+  /*!\brief Get path of the file holding an entry list
+
+    \param[in] key Key returned by EntryLists::Key()
+
+    \return Path to the entry list
+  */
+  string ListPath(const string &key){
+    return cache_directory+"/"+key+".entries";
+  }
+}
+
+namespace EntryLists{
+  /*!\brief Get directory holding the entry lists
+
+    \return Directory, relative to the working directory unless absolute
+  */
+  const string & CacheDirectory(){
+    return cache_directory;
+  }
+
+  /*!\brief Set directory holding the entry lists
+
+    \param[in] directory Directory, relative to the working directory unless
+    absolute
+  */
+  void CacheDirectory(const string &directory){
+    cache_directory = directory;
+  }
+
+  /*!\brief Get key identifying the entries of some files passing a cut
+
+    \param[in] file_names Files of the Baby, in TChain order
+
+    \param[in] cut Canonical key of the cut, see NamedFunc::Key()
+
+    \return Hash of the cut and the identity of the files, or an empty string if
+    a file cannot be found
+  */
+  string Key(const set<string> &file_names, const string &cut){
+    string identity = cut;
+    for(const auto &file_name: file_names){
+      long size = -1, mtime = -1;
+      if(!FileStatus(file_name, size, mtime)) return "";
+      identity += "\n"+CanonicalPath(file_name)+" "+to_string(size)+" "+to_string(mtime);
+    }
+    return HashString(identity);
+  }
+
+  /*!\brief Read an entry list
+
+    \param[in] key Key returned by Key()
+
+    \param[out] entries Sorted TChain entries passing the cut
+
+    \return False if the list has not been recorded
+  */
+  bool Read(const string &key, vector<long> &entries){
+    entries.clear();
+    if(key == "") return false;
+    ifstream file(ListPath(key), ios::binary);
+    if(!file) return false;
+    long num_entries = -1;
+    file.read(reinterpret_cast<char*>(&num_entries), sizeof(num_entries));
+    if(!file || num_entries < 0) return false;
+    entries.resize(num_entries);
+    file.read(reinterpret_cast<char*>(entries.data()), num_entries*sizeof(long));
+    if(!file){
+      entries.clear();
+      return false;
+    }
+    return true;
+  }
+
+  /*!\brief Write an entry list
+
+    The list is written to a temporary file and renamed, so that a concurrent
+    job never reads a partial list.
+
+    \param[in] key Key returned by Key()
+
+    \param[in] entries Sorted TChain entries passing the cut
+  */
+  void Write(const string &key, const vector<long> &entries){
+    if(key == "") return;
+    gSystem->mkdir(cache_directory.c_str(), true);
+    string path = ListPath(key);
+    string temp_path = path+".tmp"+to_string(gSystem->GetPid());
+    {
+      ofstream file(temp_path, ios::binary);
+      long num_entries = entries.size();
+      file.write(reinterpret_cast<const char*>(&num_entries), sizeof(num_entries));
+      file.write(reinterpret_cast<const char*>(entries.data()), num_entries*sizeof(long));
+      if(!file) ERROR("Could not write "+temp_path);
+    }
+    if(rename(temp_path.c_str(), path.c_str()) != 0) ERROR("Could not write "+path);
+  }
+}
@@ -1,35 +1,151 @@
+/*! \class EventScan
+
+  \brief Prints the values of several NamedFuncs for each event or object
+  passing a cut, one text file per Process
+
+  Worker threads only store the values of their entry range. Merged ranges
+  are handed through a lock-free queue to a writer thread of each SingleScan,
+  which formats them and writes them in large blocks, so the event loop never
+  waits on formatting or on the disk.
+
+  With Binary(), the values are instead written as uncompressed columns, to be
+  loaded with python/read_scan.py or any reader of raw arrays. Each scan gets
+  a directory holding row.col (and instance.col for per-object scans) with the
+  int64_t row and instance numbers, one file of doubles per printed NamedFunc
+  named after CodeToPlainText() of its name, with NaN where a vector is
+  shorter than the others, and manifest.txt, written last, listing the number
+  of entries and the type and NamedFunc of each column.
+*/
 #include "core/event_scan.hpp"
 
+#include <cstdint>
+#include <cstdio>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <iostream>
-#include <iomanip>
+#include <limits>
 
-#include <sys/stat.h>
+#include "TSystem.h"
 
 #include "core/utilities.hpp"
 
 using namespace std;
 
+namespace{
+  //!Size of the formatted text kept in memory before it is written to disk
+  constexpr size_t kWriteBlockSize = 1 << 20;
+
+  /*!\brief Appends text right-aligned in a field, like setw on an ostream
+
+    \param[in,out] buffer Text to which the field is appended
+
+    \param[in] text Text to append
+
+    \param[in] length Number of characters of text
+
+    \param[in] width Minimum width of the field
+  */
+  void AppendPadded(string &buffer, const char *text, size_t length, size_t width){
+    if(length < width) buffer.append(width-length, ' ');
+    buffer.append(text, length);
+  }
+
+  /*!\brief Appends an integer right-aligned in a field
+
+    \param[in,out] buffer Text to which the field is appended
+
+    \param[in] x Integer to append
+
+    \param[in] width Minimum width of the field
+  */
+  void AppendInteger(string &buffer, size_t x, size_t width){
+    char text[32];
+    to_chars_result result = to_chars(text, text+sizeof(text), x);
+    AppendPadded(buffer, text, static_cast<size_t>(result.ptr-text), width);
+  }
+
+  /*!\brief Appends a number right-aligned in a field, formatted as an ostream
+    with the default floatfield would
+
+    \param[in,out] buffer Text to which the field is appended
+
+    \param[in] x Number to append
+
+    \param[in] precision Significant digits
+
+    \param[in] width Minimum width of the field
+  */
+  void AppendNumber(string &buffer, double x, unsigned precision, size_t width){
+    char text[64];
+#if defined(__cpp_lib_to_chars)
+    to_chars_result result = to_chars(text, text+sizeof(text), x, chars_format::general,
+                                      max(precision, 1u));
+    size_t length = result.ec == errc() ? static_cast<size_t>(result.ptr-text) : 0;
+#else
+    int printed = snprintf(text, sizeof(text), "%.*g", static_cast<int>(max(precision, 1u)), x);
+    size_t length = printed < 0 ? 0 : min(static_cast<size_t>(printed), sizeof(text)-1);
+#endif
+    AppendPadded(buffer, text, length, width);
+  }
+}
+
 EventScan::SingleScan::SingleScan(const EventScan &event_scan,
                                   const shared_ptr<Process> &process):
   FigureComponent(event_scan, process),
-  out_(("tables/"+CodeToPlainText(event_scan.name_+"_SCAN_"+process->name_)+".txt").c_str()),
-  full_cut_(event_scan.cut_ && process->cut_),
-  cut_vector_(),
-  val_vectors_(event_scan.columns_.size()),
-  row_(0){
-  out_.precision(event_scan.Precision());
+  out_(),
+  column_files_(),
+  column_names_(),
+  num_lines_(0),
+  binary_(event_scan.Binary()),
+  is_vector_(event_scan.cut_.IsVector() || process->cut_.IsVector()),
+  shards_(),
+  row_(0),
+  precision_(event_scan.Precision()),
+  buffer_(),
+  pending_(16),
+  stop_writer_(false),
+  writer_(){
+}
+
+/*!\brief Destructor. Waits for all merged ranges to be written.
+*/
+EventScan::SingleScan::~SingleScan(){
+  StopWriter();
 }
 
-void EventScan::SingleScan::RecordEvent(const Baby &baby){
+/*!\brief Get functions evaluated by RecordEvent()
+
+  \return Cut and printed columns
+*/
+vector<NamedFunc> EventScan::SingleScan::GetFunctions() const{
   const EventScan &scan = static_cast<const EventScan&>(figure_);
-  int w = scan.width_;
-  bool isVector = !(full_cut_.IsScalar());
+  vector<NamedFunc> funcs = {scan.cut_};
+  funcs.insert(funcs.end(), scan.columns_.cbegin(), scan.columns_.cend());
+  return funcs;
+}
 
-  if(!isVector){
-    if(!full_cut_.GetScalar(baby)) return;
-  }else{
-    cut_vector_ = full_cut_.GetVector(baby);
-  }
+/*!\brief Makes room for the lines of each entry range
+
+  \param[in] num_shards Number of entry ranges that will be processed
+*/
+void EventScan::SingleScan::ReserveShards(size_t num_shards){
+  shards_.clear();
+  shards_.resize(num_shards);
+}
+
+void EventScan::SingleScan::RecordEvent(const Baby &baby,
+                                        const NamedFunc::VectorType *proc_cut_vector,
+                                        size_t ishard){
+  const EventScan &scan = static_cast<const EventScan&>(figure_);
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) shard_ptr.reset(new Shard(scan.columns_.size()));
+  Shard &shard = *shard_ptr;
+
+  bool isVector = false;
+  bool pass = EvaluateCut(scan.cut_, baby, proc_cut_vector, shard.cut_vector_, isVector);
+  if(!isVector && !pass) return;
   
   size_t max_size = 0; 
   for(size_t icol = 0; icol < scan.columns_.size(); ++icol){
@@ -37,48 +153,303 @@ void EventScan::SingleScan::RecordEvent(const Baby &baby){
     if(col.IsScalar()){
       if(max_size < 1) max_size = 1;
     }else{
-      val_vectors_.at(icol) = col.GetVector(baby);
-      if(val_vectors_.at(icol).size() > max_size){
-	max_size = val_vectors_.at(icol).size();
+      shard.val_vectors_.at(icol) = col.GetVector(baby);
+      if(shard.val_vectors_.at(icol).size() > max_size){
+	max_size = shard.val_vectors_.at(icol).size();
       }
     }
   }
-  if(full_cut_.IsVector() && max_size > cut_vector_.size()){
-    max_size = cut_vector_.size();
-  }
-
-  if(max_size > 0 && (row_ == 0)){
-    out_ << "      Row";
-    if(isVector) out_ <<" Instance";
-    for(const auto &col: scan.columns_){
-      out_ << ' ' << setw(w) << col.Name().substr(0,scan.width_);
-    }
-    out_.put('\n');
+  if(isVector && max_size > shard.cut_vector_.size()){
+    max_size = shard.cut_vector_.size();
   }
 
+  // Only the values are stored here. Formatting, and row numbers, which are
+  // only known once earlier ranges are merged, are left to the writer thread.
   for(size_t instance = 0; instance < max_size; ++instance){
-    out_ << setw(9) << row_;
-    if(isVector) out_ << ' ' << setw(8) << instance;
+    shard.line_rows_.push_back(shard.num_rows_);
+    shard.line_instances_.push_back(isVector ? instance : NoInstance());
     for(size_t icol = 0; icol < scan.columns_.size(); ++icol){
       const NamedFunc& col = scan.columns_.at(icol);
       if(col.IsScalar()){
-        out_ << ' ' << setw(w) << col.GetScalar(baby);
+        shard.values_.push_back(col.GetScalar(baby));
+        shard.has_value_.push_back(true);
+      }else if(instance < shard.val_vectors_.at(icol).size()){
+        shard.values_.push_back(shard.val_vectors_.at(icol).at(instance));
+        shard.has_value_.push_back(true);
       }else{
-        if(instance < val_vectors_.at(icol).size()){
-          out_ << ' ' << setw(w) << val_vectors_.at(icol).at(instance);
-        }else{
-	  out_ << ' ' << setw(w) << ' ';
-	}
+        shard.values_.push_back(0.);
+        shard.has_value_.push_back(false);
       }
     }
-    out_.put('\n');
   }
 
-  if(max_size > 0) ++row_;
+  if(max_size > 0) ++shard.num_rows_;
+}
+
+/*!\brief Hands the values of an entry range to the writer thread
+
+  Starts the writer thread if it is not already running.
+
+  \param[in] ishard Index of the entry range to merge
+*/
+void EventScan::SingleScan::MergeShard(size_t ishard){
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) return;
+  if(!writer_.joinable()){
+    OpenOutput();
+    stop_writer_.store(false, memory_order_release);
+    writer_ = thread(&SingleScan::WriteShards, this);
+  }
+  pending_.Push(move(shard_ptr));
+}
+
+/*!\brief Waits for the writer thread to write all merged ranges and flushes
+  the output files
+
+  For binary scans, also writes the manifest validating the columns.
+*/
+void EventScan::SingleScan::Flush(){
+  StopWriter();
+  OpenOutput();
+  if(binary_){
+    for(size_t ifile = 0; ifile < column_files_.size(); ++ifile){
+      if(!column_files_.at(ifile)->flush()){
+        ERROR("Could not write "+BinaryPath()+"/"+column_names_.at(ifile)+".col");
+      }
+    }
+    WriteManifest();
+  }else{
+    out_.flush();
+  }
 }
 
+/*!\brief Sets the number of significant digits of printed values
+
+  \param[in] precision Significant digits
+*/
 void EventScan::SingleScan::Precision(unsigned precision){
-  out_.precision(precision);
+  // Ranges already merged are printed with the old precision
+  StopWriter();
+  precision_ = precision;
+}
+
+/*!\brief Sets whether values are written to column files instead of text
+
+  \param[in] binary If true, write column files
+*/
+void EventScan::SingleScan::Binary(bool binary){
+  StopWriter();
+  binary_ = binary;
+}
+
+/*!\brief Get path to the text output
+
+  \return Path to the text file
+*/
+string EventScan::SingleScan::TextPath() const{
+  const EventScan &scan = static_cast<const EventScan&>(figure_);
+  return "tables/"+CodeToPlainText(scan.name_+"_SCAN_"+process_->name_)+".txt";
+}
+
+/*!\brief Get path to the binary output
+
+  \return Path to the directory holding the column files
+*/
+string EventScan::SingleScan::BinaryPath() const{
+  const EventScan &scan = static_cast<const EventScan&>(figure_);
+  return "tables/"+CodeToPlainText(scan.name_+"_SCAN_"+process_->name_);
+}
+
+/*!\brief Opens the text file or the column files, if not already open
+
+  Must not be called while the writer thread runs.
+*/
+void EventScan::SingleScan::OpenOutput(){
+  if(!binary_){
+    if(!out_.is_open()) out_.open(TextPath().c_str());
+    return;
+  }
+  if(column_files_.size() != 0) return;
+
+  const EventScan &scan = static_cast<const EventScan&>(figure_);
+  string directory = BinaryPath();
+  gSystem->mkdir(directory.c_str(), true);
+  //The old manifest would validate partially rewritten columns
+  remove((directory+"/manifest.txt").c_str());
+
+  column_names_ = {"row"};
+  if(is_vector_) column_names_.push_back("instance");
+  for(const auto &col: scan.columns_){
+    string name = CodeToPlainText(col.Name());
+    if(find(column_names_.cbegin(), column_names_.cend(), name) != column_names_.cend()){
+      ERROR("Column "+col.Name()+" would overwrite "+directory+"/"+name+".col");
+    }
+    column_names_.push_back(name);
+  }
+  for(const auto &name: column_names_){
+    string path = directory+"/"+name+".col";
+    column_files_.emplace_back(new ofstream(path.c_str(), ios::binary));
+    if(!*column_files_.back()) ERROR("Could not create "+path);
+  }
+  num_lines_ = 0;
+}
+
+/*!\brief Waits for the writer thread to write all merged ranges and exit
+*/
+void EventScan::SingleScan::StopWriter(){
+  if(!writer_.joinable()) return;
+  stop_writer_.store(true, memory_order_release);
+  writer_.join();
+}
+
+/*!\brief Body of the writer thread. Writes merged ranges in order until told
+  to stop and none are left.
+*/
+void EventScan::SingleScan::WriteShards(){
+  unique_ptr<Shard> shard;
+  while(true){
+    // Read the flag before the queue so that a range pushed before the stop
+    // request is never missed
+    bool stopping = stop_writer_.load(memory_order_acquire);
+    if(pending_.TryPop(shard)){
+      WriteShard(*shard);
+      shard.reset();
+    }else if(stopping){
+      break;
+    }else{
+      this_thread::sleep_for(chrono::microseconds(200));
+    }
+  }
+  if(buffer_.size() != 0){
+    out_.write(buffer_.data(), static_cast<streamsize>(buffer_.size()));
+    buffer_.clear();
+  }
+}
+
+/*!\brief Writes the lines of an entry range
+
+  \param[in] shard Values of the entry range
+*/
+void EventScan::SingleScan::WriteShard(const Shard &shard){
+  if(binary_) WriteColumns(shard);
+  else WriteText(shard);
+  row_ += shard.num_rows_;
+}
+
+/*!\brief Formats the lines of an entry range, writing them to the output file
+  whenever enough text has built up
+
+  \param[in] shard Values of the entry range
+*/
+void EventScan::SingleScan::WriteText(const Shard &shard){
+  const EventScan &scan = static_cast<const EventScan&>(figure_);
+  size_t w = scan.width_;
+  size_t num_columns = scan.columns_.size();
+
+  if(shard.num_rows_ > 0 && (row_ == 0)){
+    buffer_ += "      Row";
+    if(is_vector_) buffer_ += " Instance";
+    for(const auto &col: scan.columns_){
+      string name = col.Name().substr(0,scan.width_);
+      buffer_ += ' ';
+      AppendPadded(buffer_, name.data(), name.size(), w);
+    }
+    buffer_ += '\n';
+  }
+
+  for(size_t iline = 0; iline < shard.line_rows_.size(); ++iline){
+    AppendInteger(buffer_, row_+shard.line_rows_[iline], 9);
+    if(shard.line_instances_[iline] != NoInstance()){
+      buffer_ += ' ';
+      AppendInteger(buffer_, shard.line_instances_[iline], 8);
+    }
+    for(size_t icol = 0; icol < num_columns; ++icol){
+      size_t ivalue = iline*num_columns+icol;
+      buffer_ += ' ';
+      if(shard.has_value_[ivalue]){
+        AppendNumber(buffer_, shard.values_[ivalue], precision_, w);
+      }else{
+        buffer_.append(w, ' ');
+      }
+    }
+    buffer_ += '\n';
+    if(buffer_.size() >= kWriteBlockSize){
+      out_.write(buffer_.data(), static_cast<streamsize>(buffer_.size()));
+      buffer_.clear();
+    }
+  }
+}
+
+/*!\brief Appends the lines of an entry range to the column files
+
+  \param[in] shard Values of the entry range
+*/
+void EventScan::SingleScan::WriteColumns(const Shard &shard){
+  size_t num_lines = shard.line_rows_.size();
+  size_t num_columns = static_cast<const EventScan&>(figure_).columns_.size();
+  size_t ifile = 0;
+
+  vector<int64_t> indices(num_lines);
+  for(size_t iline = 0; iline < num_lines; ++iline){
+    indices[iline] = static_cast<int64_t>(row_+shard.line_rows_[iline]);
+  }
+  column_files_[ifile++]->write(reinterpret_cast<const char*>(indices.data()),
+                                static_cast<streamsize>(num_lines*sizeof(int64_t)));
+  if(is_vector_){
+    for(size_t iline = 0; iline < num_lines; ++iline){
+      size_t instance = shard.line_instances_[iline];
+      indices[iline] = instance == NoInstance() ? -1 : static_cast<int64_t>(instance);
+    }
+    column_files_[ifile++]->write(reinterpret_cast<const char*>(indices.data()),
+                                  static_cast<streamsize>(num_lines*sizeof(int64_t)));
+  }
+
+  vector<double> values(num_lines);
+  for(size_t icol = 0; icol < num_columns; ++icol){
+    for(size_t iline = 0; iline < num_lines; ++iline){
+      size_t ivalue = iline*num_columns+icol;
+      values[iline] = shard.has_value_[ivalue] ? shard.values_[ivalue] : numeric_limits<double>::quiet_NaN();
+    }
+    column_files_[ifile++]->write(reinterpret_cast<const char*>(values.data()),
+                                  static_cast<streamsize>(num_lines*sizeof(double)));
+  }
+  num_lines_ += num_lines;
+}
+
+/*!\brief Writes the manifest listing the number of entries and the type of
+  each column file
+
+  Must be called after all column files are flushed.
+*/
+void EventScan::SingleScan::WriteManifest() const{
+  const EventScan &scan = static_cast<const EventScan&>(figure_);
+  string path = BinaryPath()+"/manifest.txt";
+  ofstream manifest(path.c_str());
+  if(!manifest) ERROR("Could not write "+path);
+  manifest << "entries " << num_lines_ << '\n';
+  size_t first_value = column_names_.size()-scan.columns_.size();
+  for(size_t ifile = 0; ifile < column_names_.size(); ++ifile){
+    if(ifile < first_value){
+      manifest << "column " << column_names_.at(ifile) << " int64_t " << column_names_.at(ifile) << '\n';
+    }else{
+      manifest << "column " << column_names_.at(ifile) << " double "
+               << scan.columns_.at(ifile-first_value).Name() << '\n';
+    }
+  }
+}
+
+/*!\brief Standard constructor
+
+  \param[in] num_columns Number of columns in the scan
+*/
+EventScan::SingleScan::Shard::Shard(size_t num_columns):
+  values_(),
+  has_value_(),
+  line_rows_(),
+  line_instances_(),
+  num_rows_(0),
+  cut_vector_(),
+  val_vectors_(num_columns){
 }
 
 EventScan::EventScan(const string &name,
@@ -91,7 +462,8 @@ EventScan::EventScan(const string &name,
   columns_(columns),
   scans_(),
   precision_(precision),
-  width_(precision+6){
+  width_(precision+6),
+  binary_(false){
   for(const auto& proc: processes){
     scans_.emplace_back(new SingleScan(*this, proc));
   }
@@ -100,7 +472,9 @@ EventScan::EventScan(const string &name,
 void EventScan::Print(double /*luminosity*/,
                       const std::string & /*subdir*/){
   for(const auto &scan: scans_){
-    cout << " less " << ("tables/"+CodeToPlainText(name_+"_SCAN_"+scan->process_->name_)+".txt") << endl;
+    scan->Flush();
+    if(binary_) cout << " python/read_scan.py " << scan->BinaryPath() << endl;
+    else cout << " less " << scan->TextPath() << endl;
   }
 }
 
@@ -131,3 +505,22 @@ EventScan & EventScan::Precision(unsigned precision){
   }
   return *this;
 }
+
+bool EventScan::Binary() const{
+  return binary_;
+}
+
+/*!\brief Sets whether values are written to column files instead of text
+
+  \param[in] binary If true, each process gets a directory of uncompressed
+  columns instead of a text file
+
+  \return Reference to *this
+*/
+EventScan & EventScan::Binary(bool binary){
+  binary_ = binary;
+  for(auto &scan: scans_){
+    scan->Binary(binary);
+  }
+  return *this;
+}
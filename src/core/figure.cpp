@@ -1,3 +1,22 @@
+/*! \class Figure::FigureComponent
+
+  \brief Part of a Figure filled from the events of a single Process
+
+  PlotMaker splits the entries of each Baby into ranges that may be processed
+  concurrently. Components keep separate accumulators ("shards") for each
+  range: ReserveShards() allocates room for them, RecordEvent() only touches the
+  shard of the range it is given, so no locking is needed while filling, and
+  MergeShard() folds a finished range into the component. PlotMaker calls
+  MergeShard() from a single thread in increasing range order, so the merged
+  result does not depend on thread scheduling. Shards should be created on
+  the first RecordEvent() of a range and released by MergeShard(): PlotMaker
+  only queues a bounded number of ranges ahead of the merge, so memory then
+  does not grow with the number of ranges.
+
+  The Process cut is evaluated once per event by PlotMaker, before any
+  component sees the event, so components only store and evaluate the
+  figure-specific part of the selection.
+*/
 #include "core/figure.hpp"
 
 #include "core/utilities.hpp"
@@ -7,6 +26,50 @@ using namespace std;
 Figure::FigureComponent::FigureComponent(const Figure &figure,
                                          const shared_ptr<Process> &process):
   figure_(figure),
-  process_(process),
-  mutex_(){
+  process_(process){
+}
+
+/*!\brief Evaluates the figure-specific cut combined with the Process cut
+
+  The result matches evaluating cut && process->cut_, but reuses the Process
+  cut already computed by PlotMaker.
+
+  \param[in] cut Figure-specific cut
+
+  \param[in] baby Baby with the current event loaded
+
+  \param[in] proc_cut_vector Per-object results of the Process cut, or nullptr
+  if the Process cut is a scalar (and therefore known to pass)
+
+  \param[out] cut_vector Per-object results of the combined cut. Only set if
+  cut_is_vector is true
+
+  \param[out] cut_is_vector Whether the combined cut has per-object results
+
+  \return False if the combined cut rejects the whole event
+*/
+bool Figure::FigureComponent::EvaluateCut(const NamedFunc &cut,
+                                          const Baby &baby,
+                                          const NamedFunc::VectorType *proc_cut_vector,
+                                          NamedFunc::VectorType &cut_vector,
+                                          bool &cut_is_vector){
+  cut_is_vector = cut.IsVector() || proc_cut_vector != nullptr;
+  if(cut.IsScalar()){
+    bool pass = cut.IsConstant() ? cut.ConstantValue() : cut.GetScalar(baby);
+    if(!cut_is_vector) return pass;
+    if(!pass){
+      cut_vector.assign(proc_cut_vector->size(), 0.);
+      return false;
+    }
+    cut_vector = *proc_cut_vector;
+  }else{
+    cut_vector = cut.GetVector(baby);
+    if(proc_cut_vector != nullptr){
+      if(cut_vector.size() > proc_cut_vector->size()) cut_vector.resize(proc_cut_vector->size());
+      for(size_t i = 0; i < cut_vector.size(); ++i){
+        cut_vector.at(i) = cut_vector.at(i) && proc_cut_vector->at(i);
+      }
+    }
+  }
+  return HavePass(cut_vector);
 }
@@ -14,6 +14,12 @@
 
   Parentheses and brackets are parsed recursively and can be arbitrarily nested.
 
+  While merging, operations on constants are simplified: constant
+  subexpressions are folded, identities like "x*1" and "x+0" are dropped,
+  divisions by a constant become multiplications, and "&&" or "||" with a
+  constant are short-circuited. The final NamedFunc reports
+  NamedFunc::IsConstant() if the whole expression reduces to a number.
+
   Currently has support for the basic arithmetic, logical, and comparison
   operators. Future versions may support ROOT's function syntax,
   e.g. Sum\$(jets_pt).
@@ -22,6 +28,7 @@
 
 #include <cstdlib>
 #include <cctype>
+#include <cmath>
 
 #include "core/utilities.hpp"
 #include "core/named_func.hpp"
@@ -34,6 +41,139 @@ using VectorType = NamedFunc::VectorType;
 using ScalarFunc = NamedFunc::ScalarFunc;
 using VectorFunc = NamedFunc::VectorFunc;
 
+namespace{
+  /*!\brief Check if the result of f can only be 0 or 1
+
+    Judged from the operator at the top level of the key of f, so Baby
+    variables of type bool are not recognized.
+
+    \param[in] f Function to check
+
+    \return True if f is a comparison, a logical operation, or the constant 0 or 1
+  */
+  bool IsBoolean(const NamedFunc &f){
+    if(f.IsConstant()) return f.ConstantValue() == 0. || f.ConstantValue() == 1.;
+    const string &key = f.Key();
+    int depth = 0;
+    for(const auto &c: key){
+      if(c == '(' || c == '['){
+        ++depth;
+      }else if(c == ')' || c == ']'){
+        --depth;
+      }else if(depth == 0 && (c == '<' || c == '>' || c == '=' || c == '!' || c == '&' || c == '|')){
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /*!\brief Get string representation of a binary operator
+
+    \param[in] op Type of the operator Token
+
+    \return Operator as written in C++
+  */
+  string OperatorString(Token::Type op){
+    if(op == Token::Type::multiply) return "*";
+    if(op == Token::Type::divide) return "/";
+    if(op == Token::Type::modulus) return "%";
+    if(op == Token::Type::binary_plus) return "+";
+    if(op == Token::Type::binary_minus) return "-";
+    if(op == Token::Type::greater) return ">";
+    if(op == Token::Type::less) return "<";
+    if(op == Token::Type::greater_equal) return ">=";
+    if(op == Token::Type::less_equal) return "<=";
+    if(op == Token::Type::equal) return "==";
+    if(op == Token::Type::not_equal) return "!=";
+    if(op == Token::Type::logical_and) return "&&";
+    if(op == Token::Type::logical_or) return "||";
+    ERROR("Token type "+to_string(static_cast<int>(op))+" is not a binary operator");
+    return "";
+  }
+
+  /*!\brief Apply a binary operator to two numbers
+
+    \param[in] op Type of the operator Token
+
+    \param[in] a Left hand operand
+
+    \param[in] b Right hand operand
+
+    \return Result of the operation, as NamedFunc would compute it
+  */
+  ScalarType Fold(Token::Type op, ScalarType a, ScalarType b){
+    if(op == Token::Type::multiply) return a*b;
+    if(op == Token::Type::divide) return a/b;
+    if(op == Token::Type::modulus) return fmod(a, b);
+    if(op == Token::Type::binary_plus) return a+b;
+    if(op == Token::Type::binary_minus) return a-b;
+    if(op == Token::Type::greater) return a>b;
+    if(op == Token::Type::less) return a<b;
+    if(op == Token::Type::greater_equal) return a>=b;
+    if(op == Token::Type::less_equal) return a<=b;
+    if(op == Token::Type::equal) return a==b;
+    if(op == Token::Type::not_equal) return a!=b;
+    if(op == Token::Type::logical_and) return a&&b;
+    if(op == Token::Type::logical_or) return a||b;
+    ERROR("Token type "+to_string(static_cast<int>(op))+" is not a binary operator");
+    return 0.;
+  }
+
+  /*!\brief Apply a binary operator to two functions, simplifying the result if
+    either is constant
+
+    Operations between constants are folded into a constant. Adding or
+    subtracting 0 and multiplying or dividing by 1 return the other operand,
+    and other divisions by a constant become multiplications by its
+    inverse. "&&" and "||" with a constant are reduced to a constant or to the
+    other operand when the result is known to be boolean.
+
+    \param[in] op Type of the operator Token
+
+    \param[in] a Left hand operand
+
+    \param[in] b Right hand operand
+
+    \return Token containing the merged function
+  */
+  Token Merge(Token::Type op, const NamedFunc &a, const NamedFunc &b){
+    string name = "(" + a.Name() + ")" + OperatorString(op) + "(" + b.Name() + ")";
+    if(a.IsConstant() && b.IsConstant()){
+      return Token(NamedFunc(Fold(op, a.ConstantValue(), b.ConstantValue())).Name(name));
+    }
+    bool is_and = op == Token::Type::logical_and;
+    bool is_or = op == Token::Type::logical_or;
+    if(a.IsConstant()){
+      ScalarType x = a.ConstantValue();
+      if((op == Token::Type::binary_plus && x == 0.)
+         || (op == Token::Type::multiply && x == 1.)) return Token(NamedFunc(b).Name(name));
+      if(b.IsScalar() && ((is_and && x == 0.) || (is_or && x != 0.))) return Token(NamedFunc(x != 0.).Name(name));
+      if(IsBoolean(b) && ((is_and && x != 0.) || (is_or && x == 0.))) return Token(NamedFunc(b).Name(name));
+    }else if(b.IsConstant()){
+      ScalarType x = b.ConstantValue();
+      if(((op == Token::Type::binary_plus || op == Token::Type::binary_minus) && x == 0.)
+         || ((op == Token::Type::multiply || op == Token::Type::divide) && x == 1.)) return Token(NamedFunc(a).Name(name));
+      if(a.IsScalar() && ((is_and && x == 0.) || (is_or && x != 0.))) return Token(NamedFunc(x != 0.).Name(name));
+      if(IsBoolean(a) && ((is_and && x != 0.) || (is_or && x == 0.))) return Token(NamedFunc(a).Name(name));
+      if(op == Token::Type::divide && x != 0. && isfinite(1./x)) return Token(NamedFunc(a * NamedFunc(1./x)).Name(name));
+    }
+
+    if(op == Token::Type::multiply) return Token(NamedFunc(a * b));
+    if(op == Token::Type::divide) return Token(NamedFunc(a / b));
+    if(op == Token::Type::modulus) return Token(NamedFunc(a % b));
+    if(op == Token::Type::binary_plus) return Token(NamedFunc(a + b));
+    if(op == Token::Type::binary_minus) return Token(NamedFunc(a - b));
+    if(op == Token::Type::greater) return Token(NamedFunc(a > b));
+    if(op == Token::Type::less) return Token(NamedFunc(a < b));
+    if(op == Token::Type::greater_equal) return Token(NamedFunc(a >= b));
+    if(op == Token::Type::less_equal) return Token(NamedFunc(a <= b));
+    if(op == Token::Type::equal) return Token(NamedFunc(a == b));
+    if(op == Token::Type::not_equal) return Token(NamedFunc(a != b));
+    if(op == Token::Type::logical_and) return Token(NamedFunc(a && b));
+    return Token(NamedFunc(a || b));
+  }
+}
+
 /*!\brief Standard constructor from string representing a function
 
   \param[in] function_string String representing a number, variable, function,
@@ -88,7 +228,7 @@ NamedFunc FunctionParser::ResolveAsNamedFunc() const{
     : NamedFunc(input_string_,
                 [](const Baby &){
                   return 0.;
-                });
+                }).Branches(set<string>());
 }
 
 /*!\brief Constructs FunctionParser from list of \link Token Tokens\endlink
@@ -182,15 +322,13 @@ void FunctionParser::ResolveVariables() const{
       // if(Functions::func_map.find(token.string_rep_) != Functions::func_map.end()){
       // 	token = Functions::func_map.at(token.string_rep_);
       token.function_ = Baby::GetFunction(token.string_rep_);
+      token.function_.Key(token.string_rep_, false);
       token.type_ = token.function_.IsScalar() ? Token::Type::resolved_scalar : Token::Type::resolved_vector;
       
     }else if(token.type_ == Token::Type::number){
       char *cp = nullptr;
       NamedFunc::ScalarType val = strtod(&token.string_rep_[0], &cp);
-      token.function_ = NamedFunc(token.string_rep_,
-                                  [val](const Baby &){
-                                    return val;
-                                  });
+      token.function_ = NamedFunc(val).Name(token.string_rep_);
       token.type_ = Token::Type::resolved_scalar;
     }
   }
@@ -257,13 +395,9 @@ void FunctionParser::ApplySubscripts() const{
       continue;
     }
 
-    function<VectorFunc> vec_func = vec.function_.VectorFunction();
-    function<ScalarFunc> sub_func = sub.function_.ScalarFunction();
-    function<ScalarFunc> function = [vec_func,sub_func](const Baby &b){
-      return vec_func(b).at(sub_func(b));
-    };
-    string name = ConcatenateTokenStrings(i, i+4);
-    Token merged(NamedFunc(name, function));
+    NamedFunc merged_func = vec.function_[sub.function_];
+    merged_func.Name(ConcatenateTokenStrings(i, i+4));
+    Token merged(merged_func);
 
     CondenseTokens(i, i+4, merged);
   }
@@ -343,12 +477,13 @@ void FunctionParser::ApplyUnary() const{
     if(x.type_ != Token::Type::resolved_scalar && x.type_ != Token::Type::resolved_vector) continue;
 
     Token merged;
+    const NamedFunc &f = x.function_;
     if(op.type_ == Token::Type::unary_plus){
-      merged = Token(NamedFunc(+x.function_));
+      merged = Token(NamedFunc(+f));
     }else if(op.type_ == Token::Type::unary_minus){
-      merged = Token(NamedFunc(-x.function_));
+      merged = Token(f.IsConstant() ? NamedFunc(-f.ConstantValue()).Name("-("+f.Name()+")") : NamedFunc(-f));
     }else if(op.type_ == Token::Type::logical_not){
-      merged = Token(NamedFunc(!x.function_));
+      merged = Token(f.IsConstant() ? NamedFunc(!f.ConstantValue()).Name("!("+f.Name()+")") : NamedFunc(!f));
     }else{
       continue;
     }
@@ -371,18 +506,11 @@ void FunctionParser::MultiplyAndDivide() const{
     if(a.type_ != Token::Type::resolved_scalar && a.type_ != Token::Type::resolved_vector) continue;
     if(b.type_ != Token::Type::resolved_scalar && b.type_ != Token::Type::resolved_vector) continue;
 
-    Token merged;
-    if(op.type_ == Token::Type::multiply){
-      merged = Token(NamedFunc(a.function_ * b.function_));
-    }else if(op.type_ == Token::Type::divide){
-      merged = Token(NamedFunc(a.function_ / b.function_));
-    }else if(op.type_ == Token::Type::modulus){
-      merged = Token(NamedFunc(a.function_ % b.function_));
-    }else{
-      continue;
-    }
+    if(op.type_ != Token::Type::multiply
+       && op.type_ != Token::Type::divide
+       && op.type_ != Token::Type::modulus) continue;
 
-    CondenseTokens(i, i+3, merged);
+    CondenseTokens(i, i+3, Merge(op.type_, a.function_, b.function_));
     --i;//Need to recheck token in case of successive multiplications
   }
 }
@@ -401,16 +529,10 @@ void FunctionParser::AddAndSubtract() const{
     if(a.type_ != Token::Type::resolved_scalar && a.type_ != Token::Type::resolved_vector) continue;
     if(b.type_ != Token::Type::resolved_scalar && b.type_ != Token::Type::resolved_vector) continue;
 
-    Token merged;
-    if(op.type_ == Token::Type::binary_plus){
-      merged = Token(NamedFunc(a.function_ + b.function_));
-    }else if(op.type_ == Token::Type::binary_minus){
-      merged = Token(NamedFunc(a.function_ - b.function_));
-    }else{
-      continue;
-    }
+    if(op.type_ != Token::Type::binary_plus
+       && op.type_ != Token::Type::binary_minus) continue;
 
-    CondenseTokens(i, i+3, merged);
+    CondenseTokens(i, i+3, Merge(op.type_, a.function_, b.function_));
     --i;//Need to recheck token in case of successive additions
   }
 }
@@ -429,20 +551,12 @@ void FunctionParser::LessGreater() const{
     if(a.type_ != Token::Type::resolved_scalar && a.type_ != Token::Type::resolved_vector) continue;
     if(b.type_ != Token::Type::resolved_scalar && b.type_ != Token::Type::resolved_vector) continue;
 
-    Token merged;
-    if(op.type_ == Token::Type::greater){
-      merged = Token(NamedFunc(a.function_ > b.function_));
-    }else if(op.type_ == Token::Type::less){
-      merged = Token(NamedFunc(a.function_ < b.function_));
-    }else if(op.type_ == Token::Type::greater_equal){
-      merged = Token(NamedFunc(a.function_ >= b.function_));
-    }else if(op.type_ == Token::Type::less_equal){
-      merged = Token(NamedFunc(a.function_ <= b.function_));
-    }else{
-      continue;
-    }
+    if(op.type_ != Token::Type::greater
+       && op.type_ != Token::Type::less
+       && op.type_ != Token::Type::greater_equal
+       && op.type_ != Token::Type::less_equal) continue;
 
-    CondenseTokens(i, i+3, merged);
+    CondenseTokens(i, i+3, Merge(op.type_, a.function_, b.function_));
     --i;//Need to recheck token in case of successive comparisons
   }
 }
@@ -460,16 +574,10 @@ void FunctionParser::EqualOrNot() const{
     if(a.type_ != Token::Type::resolved_scalar && a.type_ != Token::Type::resolved_vector) continue;
     if(b.type_ != Token::Type::resolved_scalar && b.type_ != Token::Type::resolved_vector) continue;
 
-    Token merged;
-    if(op.type_ == Token::Type::equal){
-      merged = Token(NamedFunc(a.function_ == b.function_));
-    }else if(op.type_ == Token::Type::not_equal){
-      merged = Token(NamedFunc(a.function_ != b.function_));
-    }else{
-      continue;
-    }
+    if(op.type_ != Token::Type::equal
+       && op.type_ != Token::Type::not_equal) continue;
 
-    CondenseTokens(i, i+3, merged);
+    CondenseTokens(i, i+3, Merge(op.type_, a.function_, b.function_));
     --i;//Need to recheck token in case of successive comparisons
   }
 }
@@ -479,6 +587,7 @@ void FunctionParser::EqualOrNot() const{
   Searches for patten {value}{&&}{value} and replaces with single Token
 */
 void FunctionParser::And() const{
+  if(NamedFunc::AdaptiveLogic() > 0) MergeChains(Token::Type::logical_and);
   for(size_t i = 0; i+2 < tokens_.size(); ++i){
     Token &a = tokens_.at(i);
     Token &op = tokens_.at(i+1);
@@ -487,14 +596,9 @@ void FunctionParser::And() const{
     if(a.type_ != Token::Type::resolved_scalar && a.type_ != Token::Type::resolved_vector) continue;
     if(b.type_ != Token::Type::resolved_scalar && b.type_ != Token::Type::resolved_vector) continue;
 
-    Token merged;
-    if(op.type_ == Token::Type::logical_and){
-      merged = Token(NamedFunc(a.function_ && b.function_));
-    }else{
-      continue;
-    }
+    if(op.type_ != Token::Type::logical_and) continue;
 
-    CondenseTokens(i, i+3, merged);
+    CondenseTokens(i, i+3, Merge(op.type_, a.function_, b.function_));
     --i;//Need to recheck token in case of successive ANDs
   }
 }
@@ -504,6 +608,7 @@ void FunctionParser::And() const{
   Searches for patten {value}{||}{value} and replaces with single Token
 */
 void FunctionParser::Or() const{
+  if(NamedFunc::AdaptiveLogic() > 0) MergeChains(Token::Type::logical_or);
   for(size_t i = 0; i+2 < tokens_.size(); ++i){
     Token &a = tokens_.at(i);
     Token &op = tokens_.at(i+1);
@@ -512,18 +617,45 @@ void FunctionParser::Or() const{
     if(a.type_ != Token::Type::resolved_scalar && a.type_ != Token::Type::resolved_vector) continue;
     if(b.type_ != Token::Type::resolved_scalar && b.type_ != Token::Type::resolved_vector) continue;
 
-    Token merged;
-    if(op.type_ == Token::Type::logical_or){
-      merged = Token(NamedFunc(a.function_ || b.function_));
-    }else{
-      continue;
-    }
+    if(op.type_ != Token::Type::logical_or) continue;
 
-    CondenseTokens(i, i+3, merged);
+    CondenseTokens(i, i+3, Merge(op.type_, a.function_, b.function_));
     --i;//Need to recheck token in case of successive ORs
   }
 }
 
+/*!\brief Merges runs of scalar operands joined by "&&" or "||" into a single
+  Token evaluating them in adaptive order
+
+  Searches for pattern {value}{op}{value}{op}... starting at the beginning of
+  a run and replaces the longest prefix of non-constant scalar values with a
+  single Token. \see NamedFunc::AdaptiveLogic()
+
+  \param[in] op Token::Type::logical_and or Token::Type::logical_or
+*/
+void FunctionParser::MergeChains(Token::Type op) const{
+  for(size_t i = 0; i < tokens_.size(); ++i){
+    if(i > 0 && tokens_.at(i-1).type_ == op) continue;
+    vector<NamedFunc> terms;
+    size_t end = i;
+    while(end < tokens_.size()
+          && tokens_.at(end).type_ == Token::Type::resolved_scalar
+          && !tokens_.at(end).function_.IsConstant()){
+      terms.push_back(tokens_.at(end).function_);
+      if(end+2 >= tokens_.size() || tokens_.at(end+1).type_ != op){
+        ++end;
+        break;
+      }
+      end += 2;
+    }
+    if(terms.size() < 2) continue;
+    if(end > i && tokens_.at(end-1).type_ == op) --end;
+
+    NamedFunc merged = op == Token::Type::logical_and ? AdaptiveAnd(terms) : AdaptiveOr(terms);
+    CondenseTokens(i, end, Token(merged));
+  }
+}
+
 /*!\brief Check that we have a single Token with a valid NamedFun
  */
 void FunctionParser::CheckSolved() const{
@@ -15,30 +15,44 @@
   Used only to generate Baby classes, but not in subsequent analysis code.
 */
 #include "core/generate_baby.hpp"
+#include "core/cpp_expression.hpp"
 
 #define ERROR(x) throw std::runtime_error(string("Error in file ")+__FILE__+" at line "+to_string(__LINE__)+" (in "+__func__+"): "+x);
 #define DBG(x) std::cout << "In " << __FILE__ << " at line " << __LINE__ << " (in function " << __func__ << "): " << x << std::endl;
 
 #include <cctype>
 
+#include <map>
 #include <string>
 #include <vector>
 #include <stdexcept>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <algorithm>
 
 using namespace std;
 
 int main(int argc, char *argv[]){
-  vector<string> files;
+  vector<string> files, sources;
+  bool write_functions = false;
   for(int argi = 1; argi < argc; ++argi){
-    files.push_back(argv[argi]);
     string test = argv[argi];
-    DBG("Doing file "+test);
+    if(test == "--functions"){
+      write_functions = true;
+    }else if(write_functions){
+      sources.push_back(test);
+    }else{
+      files.push_back(test);
+      DBG("Doing file "+test);
+    }
   }
   vector<string> tree_names;
   set<Variable> vars = GetVariables(files, tree_names);
+  if(write_functions){
+    WriteCompiledFunctions(vars, files, CollectExpressions(sources));
+    return 0;
+  }
   WriteBaseHeader(vars, files);
   WriteBaseSource(vars, files);
   for(unsigned ifile=0; ifile<files.size(); ifile++){
@@ -450,6 +464,87 @@ string ToLower(string x){
   return x;
 }
 
+/*!\brief Checks if a variable type can be read a basket at a time by BulkBranch
+
+  \param[in] type Type of the variable
+
+  \return True for double, float, int32_t, and bool
+*/
+bool IsBulkType(const string &type){
+  return type == "double" || type == "float" || type == "int32_t" || type == "bool";
+}
+
+/*!\brief Get name of the accessor of a variable in a derived Baby class
+
+  \param[in] var Variable implemented in the derived class
+
+  \param[in] type Name of derived Baby class (basic, full, etc.)
+
+  \return Name of the variable, with its type index if it has different types
+  in different Baby classes
+*/
+string MemberName(const Variable &var, const string &type){
+  return var.MultipleTypes() ? var.Name()+var.VarIndex(type) : var.Name();
+}
+
+/*!\brief Writes the statements reading a variable for the current entry
+
+  \param[in,out] file Source file being written
+
+  \param[in] varname Name of the accessor, also used for the cached value,
+  branch, and stamp
+
+  \param[in] type Type of the variable
+
+  \param[in] indent Indentation of the statements
+*/
+void WriteBranchRead(ofstream &file, const string &varname, const string &type,
+                     const string &indent){
+  if(IsBulkType(type)){
+    file << indent << "if(!bulk_read_ || !bulk_" << varname << "_.Read(b_" << varname
+         << "_, tree_first_entry_, entry_, " << varname << "_)){\n";
+    file << indent << "  b_" << varname << "_->GetEntry(entry_);\n";
+    file << indent << "}\n";
+  }else{
+    file << indent << "b_" << varname << "_->GetEntry(entry_);\n";
+  }
+  file << indent << "e_" << varname << "_ = epoch_;\n";
+}
+
+/*!\brief Writes the body of a lazy accessor
+
+  \param[in,out] file Source file being written
+
+  \param[in] varname Name of the accessor, also used for the cached value,
+  branch, and stamp
+
+  \param[in] type Type of the variable
+*/
+void WriteAccessorBody(ofstream &file, const string &varname, const string &type){
+  file << "  if(e_" << varname << "_ != epoch_ && b_" << varname << "_){\n";
+  WriteBranchRead(file, varname, type, "    ");
+  file << "  }\n";
+  file << "  return " << varname << "_;\n";
+}
+
+/*!\brief Writes the inline accessor of a variable in a derived Baby class
+
+  Only the check of the epoch stamp is inlined. Reading the branch is left to
+  Read_<varname>(), defined in the source file.
+
+  \param[in,out] file Header file being written
+
+  \param[in] varname Name of the accessor
+
+  \param[in] decorated_type Type returned by the accessor
+*/
+void WriteInlineAccessor(ofstream &file, const string &varname, const string &decorated_type){
+  file << "  " << decorated_type << " const & " << varname << "() const final{\n";
+  file << "    if(e_" << varname << "_ != epoch_) Read_" << varname << "();\n";
+  file << "    return " << varname << "_;\n";
+  file << "  }\n";
+}
+
 /*!\brief Writes inc/baby.hpp
 
   \param[in] vars All variables for all Baby classes, with type information
@@ -470,6 +565,10 @@ void WriteBaseHeader(const set<Variable> &vars,
   file << "#include \"TChain.h\"\n\n";
   file << "#include \"TString.h\"\n\n";
 
+  file << "#include \"core/bulk_branch.hpp\"\n";
+  file << "#include \"core/column_cache.hpp\"\n";
+  file << "#include \"core/column_files.hpp\"\n\n";
+
   file << "class Process;\n";
   file << "class NamedFunc;\n\n";
 
@@ -497,7 +596,13 @@ void WriteBaseHeader(const set<Variable> &vars,
   file << "  virtual ~Baby() = default;\n\n";
 
   file << "  long GetEntries() const;\n";
-  file << "  virtual void GetEntry(long entry);\n\n";
+  file << "  void GetEntry(long entry);\n\n";
+
+  file << "  virtual std::unique_ptr<Baby> Clone() const = 0;\n\n";
+
+  file << "  static constexpr std::size_t num_types_ = " << types.size() << ";//!<Number of derived Baby classes\n";
+  file << "  //!Index of the derived class, from 0 to num_types_-1. Cheaper than typeid in per-event code.\n";
+  file << "  std::size_t TypeNumber() const{return type_number_;}\n\n";
 
   file << "  const std::set<std::string> & FileNames() const;\n\n";
   file << "  int SampleType() const;\n";
@@ -533,7 +638,41 @@ void WriteBaseHeader(const set<Variable> &vars,
 
   file << "  static NamedFunc GetFunction(const std::string &var_name);\n\n";
 
-  file << "  std::unique_ptr<Activator> Activate();\n\n";
+  file << "  struct CachedResult{\n";
+  file << "    long epoch_ = -1;//!<Value of Baby::Epoch() when the result was stored\n";
+  file << "    double scalar_ = 0.;//!<Stored scalar result\n";
+  file << "    std::vector<double> vector_{};//!<Stored vector result\n";
+  file << "  };\n\n";
+
+  file << "  //!Settings of the TTreeCache used to read the chain\n";
+  file << "  struct CacheOptions{\n";
+  file << "    long size_ = -1;//!<Cache size in bytes. Negative for ROOT's default, 0 to disable the cache.\n";
+  file << "    int learn_entries_ = 10;//!<Entries read to learn which branches to cache, if not given. Shared by all chains in ROOT.\n";
+  file << "    std::set<std::string> branches_{};//!<Branches always cached. If any, the learning phase is skipped.\n";
+  file << "    bool prefetch_ = false;//!<Whether to read the next baskets asynchronously while the current ones are processed\n";
+  file << "    bool bulk_read_ = false;//!<Whether to read double, float, int32_t, and bool branches a basket at a time (see BulkBranch)\n";
+  file << "  };\n\n";
+
+  file << "  //!Reading statistics of one file\n";
+  file << "  struct ReadStats{\n";
+  file << "    std::string file_name_ = \"\";//!<Name of the file\n";
+  file << "    long read_calls_ = 0;//!<Number of read calls to the file\n";
+  file << "    long bytes_read_ = 0;//!<Bytes read from the file\n";
+  file << "    double cache_efficiency_ = -1.;//!<Fraction of baskets found in the TTreeCache. Negative without cache.\n";
+  file << "  };\n\n";
+
+  file << "  long Epoch() const;\n";
+  file << "  CachedResult & GetCachedResult(std::size_t slot) const;\n\n";
+
+  file << "  std::unique_ptr<Activator> Activate();\n";
+  file << "  void EnableBranches(const std::set<std::string> &branches);\n\n";
+
+  file << "  const std::shared_ptr<const CacheOptions> & GetCacheOptions() const;\n";
+  file << "  void SetCacheOptions(const CacheOptions &options);\n";
+  file << "  std::vector<ReadStats> GetReadStats() const;\n\n";
+
+  file << "  void CacheColumns(const std::set<std::string> &branches, long num_entries, double max_megabytes);\n";
+  file << "  std::set<std::string> FilledColumns(const std::vector<long> *entries) const;\n\n";
 
   file << "  std::unique_ptr<TChain> chain_;//!<Chain to load variables from\n";
   file << "  std::set<std::string> file_names_;//!<Files loaded into TChain\n";
@@ -541,7 +680,16 @@ void WriteBaseHeader(const set<Variable> &vars,
   file << "protected:\n";
   file << "  virtual void Initialize();\n\n";
 
-  file << "  long entry_;//!<Current entry\n\n";
+  file << "  long entry_;//!<Current entry\n";
+  file << "  long tree_first_entry_;//!<First TChain entry of the currently loaded tree\n";
+  file << "  bool bulk_read_;//!<Whether numeric branches are read a basket at a time\n";
+  file << "  long epoch_;//!<Incremented every time the current entry changes\n";
+  file << "  std::shared_ptr<ColumnCache> column_cache_;//!<Branch values kept in memory. Shared with clones.\n";
+  file << "  std::unique_ptr<ColumnFiles> column_files_;//!<Uncompressed columns of the current file. Null if it has none.\n";
+  file << "  std::size_t type_number_;//!<Value of TypeNumber(), set by the constructor of the derived class\n\n";
+
+  file << "  virtual void AddColumns(const std::set<std::string> &branches, double max_megabytes) = 0;\n";
+  file << "  virtual void MapColumns() = 0;\n\n";
 
   file << "private:\n";
   file << "  friend class Activator;\n\n";
@@ -552,20 +700,38 @@ void WriteBaseHeader(const set<Variable> &vars,
 
   file << "  int sample_type_;//!< Integer indicating what kind of sample the first file has\n";
   file << "  mutable long total_entries_;//!<Cached number of events in TChain\n";
-  file << "  mutable bool cached_total_entries_;//!<Flag if cached event count up to date\n\n";
+  file << "  mutable bool cached_total_entries_;//!<Flag if cached event count up to date\n";
+  file << "  long tree_end_entry_;//!<One past the last TChain entry of the currently loaded tree\n";
+  file << "  std::shared_ptr<const CacheOptions> cache_options_;//!<Settings of the TTreeCache. Null to keep ROOT's defaults.\n";
+  file << "  std::vector<ReadStats> read_stats_;//!<Statistics of the files already read by the current chain\n";
+  file << "  std::shared_ptr<const std::set<std::string> > enabled_branches_;//!<Branches read through the TTreeCache. Null if all branches are read.\n";
+  file << "  mutable std::vector<CachedResult> cached_results_;//!<Per-event results of shared NamedFunc expressions\n\n";
 
   file << "  virtual void ActivateChain();\n";
-  file << "  void DeactivateChain();\n\n";
+  file << "  void DeactivateChain();\n";
+  file << "  void ConfigureCache();\n";
+  file << "  void OpenColumnFiles();\n";
+  file << "  ReadStats CurrentReadStats() const;\n\n";
 
+  file << "  //Each value follows its epoch stamp, so a cached access touches a single\n";
+  file << "  //cache line. Branches and bulk buffers are only needed once per event.\n";
   for(const auto &var: vars){
     if(!var.ImplementInBase()) continue;
-    file << "  "
+    file << "  mutable long e_" << var.Name() << "_;//!<Value of epoch_ when "
+         << var.Name() << " was last read\n";
+    file << "  mutable "
          << var.DecoratedType() << " "
          << var.Name() << "_;//!<Cached value of " << var.Name() << '\n';
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementInBase()) continue;
     file << "  TBranch *b_" << var.Name() << "_;//!<Branch from which "
          << var.Name() << " is read\n";
-    file << "  mutable bool c_" << var.Name() << "_;//!<Flag if cached "
-         << var.Name() << " up to date\n";
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementInBase() || !IsBulkType(var.Type())) continue;
+    file << "  mutable BulkBranch bulk_" << var.Name() << "_;//!<Basket from which "
+         << var.Name() << " is read in bulk\n";
   }
   file << "};\n\n";
 
@@ -604,11 +770,17 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
 
   file << "#include \"core/baby.hpp\"\n\n";
 
+  file << "#include <algorithm>\n";
+  file << "#include <iterator>\n";
   file << "#include <mutex>\n";
   file << "#include <type_traits>\n";
   file << "#include <utility>\n";
   file << "#include <stdexcept>\n\n";
 
+  file << "#include \"TEnv.h\"\n";
+  file << "#include \"TFile.h\"\n";
+  file << "#include \"TTreeCache.h\"\n\n";
+
   file << "#include \"core/named_func.hpp\"\n";
   file << "#include \"core/utilities.hpp\"\n\n";
 
@@ -620,6 +792,12 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
   file << "  using ScalarFunc = NamedFunc::ScalarFunc;\n";
   file << "  using VectorFunc = NamedFunc::VectorFunc;\n\n";
 
+  file << "  //!Entry of the table used by Baby::GetFunction\n";
+  file << "  struct FunctionEntry{\n";
+  file << "    const char *name_;//!<Name of the accessor\n";
+  file << "    NamedFunc (*get_)();//!<Builds the NamedFunc reading the variable\n";
+  file << "  };\n\n";
+
   file << "  /*!\\brief Get dummy NamedFunc in case of substitution failure\n\n";
 
   file << "    \\param[in] name Name of function/variable\n\n";
@@ -702,29 +880,29 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
   file << "  processes_(processes),\n";
   file << "  chain_(nullptr),\n";
   file << "  file_names_(file_names),\n";
+  file << "  tree_first_entry_(0),\n";
+  file << "  bulk_read_(false),\n";
+  file << "  epoch_(0),\n";
+  file << "  column_cache_(),\n";
+  file << "  column_files_(),\n";
+  file << "  type_number_(num_types_),\n";
   file << "  total_entries_(0),\n";
-  auto last_base = vars.cbegin();
-  bool found_in_base = false;
-  for(auto iter = vars.cbegin(); iter != vars.cend(); ++iter){
-    if(iter->ImplementInBase()){
-      last_base = iter;
-      found_in_base = true;
-    }
+  file << "  cached_total_entries_(false),\n";
+  file << "  tree_end_entry_(0),\n";
+  file << "  cache_options_(),\n";
+  file << "  read_stats_(),\n";
+  file << "  enabled_branches_(),\n";
+  file << "  cached_results_()";
+  for(const auto &var: vars){
+    if(!var.ImplementInBase()) continue;
+    file << ",\n  e_" << var.Name() << "_(-1),\n";
+    file << "  " << var.Name() << "_{}";
   }
-  if(vars.size() == 0 || !found_in_base){
-    file << "  cached_total_entries_(false){\n";
-  }else{
-    file << "  cached_total_entries_(false),\n";
-    for(auto var = vars.cbegin(); var != last_base; ++var){
-      if(!var->ImplementInBase()) continue;
-      file << "  " << var->Name() << "_{},\n";
-      file << "  b_" << var->Name() << "_(nullptr),\n";
-      file << "  c_" << var->Name() << "_(false),\n";
-    }
-    file << "  " << last_base->Name() << "_{},\n";
-    file << "  b_" << last_base->Name() << "_(nullptr),\n";
-    file << "  c_" << last_base->Name() << "_(false){\n";
+  for(const auto &var: vars){
+    if(!var.ImplementInBase()) continue;
+    file << ",\n  b_" << var.Name() << "_(nullptr)";
   }
+  file << "{\n";
   file << "  TString filename=\"\";\n";
   file << "  if(file_names_.size()) filename = *file_names_.cbegin();\n";
   file << "  sample_type_ = SetSampleType(filename);\n";
@@ -745,15 +923,37 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
 
   file << "/*!\\brief Change current entry\n\n";
 
+  file << "  Each Baby owns its TChain, so entries within the currently loaded tree are\n";
+  file << "  read without locking. Only moving to a new tree, which opens a file, is\n";
+  file << "  serialized with the other threads.\n\n";
+
+  file << "  Values read for the previous entry are invalidated by incrementing the\n";
+  file << "  epoch, without touching the cached variables.\n\n";
+
   file << "  \\param[in] entry Entry number to load\n";
   file << "*/\n";
   file << "void Baby::GetEntry(long entry){\n";
-  for(const auto &var: vars){
-    if(!var.ImplementInBase()) continue;
-    file << "  c_" << var.Name() << "_ = false;\n";
-  }
+  file << "  ++epoch_;\n";
+  file << "  if(entry >= tree_first_entry_ && entry < tree_end_entry_){\n";
+  file << "    entry_ = chain_->LoadTree(entry);\n";
+  file << "    return;\n";
+  file << "  }\n";
   file << "  lock_guard<mutex> lock(Multithreading::root_mutex);\n";
+  file << "  if(tree_end_entry_ > tree_first_entry_) read_stats_.push_back(CurrentReadStats());\n";
+  file << "  //Read when the cache is created, possibly while loading the tree\n";
+  file << "  if(cache_options_) gEnv->SetValue(\"TFile.AsyncPrefetching\", cache_options_->prefetch_ ? 1 : 0);\n";
   file << "  entry_ = chain_->LoadTree(entry);\n";
+  file << "  bool loaded = entry_ >= 0 && chain_->GetTree();\n";
+  file << "  if(loaded){\n";
+  file << "    tree_first_entry_ = entry - entry_;\n";
+  file << "    tree_end_entry_ = tree_first_entry_ + chain_->GetTree()->GetEntries();\n";
+  file << "  }else{\n";
+  file << "    tree_first_entry_ = 0;\n";
+  file << "    tree_end_entry_ = 0;\n";
+  file << "  }\n";
+  file << "  //The cache leaves out the branches mapped from column files\n";
+  file << "  OpenColumnFiles();\n";
+  file << "  if(loaded) ConfigureCache();\n";
   file << "}\n\n";
 
   file << "const std::set<std::string> & Baby::FileNames() const{\n";
@@ -781,38 +981,52 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
 
   file << "/*! \\brief Get a NamedFunc accessing specified variable\n\n";
 
+  file << "  Variables are looked up by binary search in a table sorted by name, built\n";
+  file << "  when the code is generated.\n\n";
+
+  file << "  \\param[in] var_name Name of the accessor\n\n";
+
   file << "  \\return NamedFunc which returns specified variable from a Baby\n";
   file << "*/\n";
   file << "NamedFunc Baby::GetFunction(const std::string &var_name){\n";
-  if(vars.size() != 0){
-    file << "  if(var_name == \"" << vars.cbegin()->Name() << "\"){\n";
-    file << "    return ::GetFunction(&Baby::" << vars.cbegin()->Name() << ", \"" << vars.cbegin()->Name() << "\");\n";
-    for(auto var = ++vars.cbegin(); var != vars.cend(); ++var){
-      if(var->MultipleTypes()) {
-        for(const auto &baby_type: types){
-          if(var->Type(baby_type) =="") continue;
-          string varname = var->Name() + var->VarIndex(baby_type);
-          file << "  }else if(var_name == \"" << varname << "\"){\n";
-          file << "    return ::GetFunction(&Baby::" << varname << ", \"" << varname << "\");\n";
-        } // for types
-      } else {
-        file << "  }else if(var_name == \"" << var->Name() << "\"){\n";
-        file << "    return ::GetFunction(&Baby::" << var->Name() << ", \"" << var->Name() << "\");\n";
+  vector<pair<string, string> > accessors;//Accessor name, branch name
+  for(const auto &var: vars){
+    if(var.MultipleTypes()){
+      for(const auto &baby_type: types){
+        if(var.Type(baby_type) == "") continue;
+        accessors.emplace_back(var.Name() + var.VarIndex(baby_type), var.Name());
       }
+    }else{
+      accessors.emplace_back(var.Name(), var.Name());
+    }
+  }
+  sort(accessors.begin(), accessors.end());
+  accessors.erase(unique(accessors.begin(), accessors.end()), accessors.end());
+  if(accessors.size() != 0){
+    file << "  static const FunctionEntry functions[] = {\n";
+    for(const auto &accessor: accessors){
+      file << "    {\"" << accessor.first << "\", [](){return ::GetFunction(&Baby::" << accessor.first
+           << ", \"" << accessor.first << "\").Branches(set<string>{\"" << accessor.second << "\"});}},\n";
     }
-    file << "  }else{\n";
-    file << "    DBG(\"Function lookup failed for \\\"\" << var_name << \"\\\"\");\n";
-    file << "    return NamedFunc(var_name,\n";
-    file << "                     [](const Baby &){\n";
-    file << "                       return 0.;\n";
-    file << "                     });\n";
+    file << "  };\n";
+    file << "  auto found = lower_bound(begin(functions), end(functions), var_name,\n";
+    file << "                           [](const FunctionEntry &entry, const string &name){\n";
+    file << "                             return entry.name_ < name;\n";
+    file << "                           });\n";
+    file << "  if(found != end(functions) && found->name_ == var_name) return found->get_();\n\n";
+
+    file << "  const char *closest = nullptr;\n";
+    file << "  size_t closest_distance = 0;\n";
+    file << "  for(const auto &entry: functions){\n";
+    file << "    size_t distance = EditDistance(var_name, entry.name_);\n";
+    file << "    if(closest == nullptr || distance < closest_distance){\n";
+    file << "      closest = entry.name_;\n";
+    file << "      closest_distance = distance;\n";
+    file << "    }\n";
     file << "  }\n";
+    file << "  ERROR(\"Unknown variable \\\"\"+var_name+\"\\\". Did you mean \\\"\"+closest+\"\\\"?\");\n";
   }else{
-    file << "  DBG(\"No variables defined in Baby.\");\n";
-    file << "  return NamedFunc(var_name,\n";
-    file << "                   [](const Baby &){\n";
-    file << "                     return 0.;\n";
-    file << "                   });\n";
+    file << "  ERROR(\"Unknown variable \\\"\"+var_name+\"\\\". No variables defined in Baby.\");\n";
   }
   file << "}\n\n";
 
@@ -820,6 +1034,166 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
   file << "  return unique_ptr<Baby::Activator>(new Baby::Activator(*this));\n";
   file << "}\n\n";
 
+  file << "/*!\\brief Read only the given branches, through a TTreeCache holding exactly them\n\n";
+
+  file << "  Must be called after Activate(). All other branches are disabled, so their\n";
+  file << "  accessors keep returning stale values. Names missing from the chain are\n";
+  file << "  ignored, and so are branches mapped from column files in each file.\n\n";
+
+  file << "  \\param[in] branches Names of the branches to read\n";
+  file << "*/\n";
+  file << "void Baby::EnableBranches(const set<string> &branches){\n";
+  file << "  if(!chain_) ERROR(\"Chain has not been initialized\");\n";
+  file << "  lock_guard<mutex> lock(Multithreading::root_mutex);\n";
+  file << "  auto enabled = make_shared<set<string> >();\n";
+  file << "  chain_->SetBranchStatus(\"*\", false);\n";
+  file << "  for(const auto &branch: branches){\n";
+  file << "    if(chain_->GetBranch(branch.c_str()) == nullptr) continue;\n";
+  file << "    chain_->SetBranchStatus(branch.c_str(), true);\n";
+  file << "    enabled->insert(branch);\n";
+  file << "  }\n";
+  file << "  enabled_branches_ = enabled;\n";
+  file << "  //Force GetEntry to set up the cache for the current tree\n";
+  file << "  tree_first_entry_ = 0;\n";
+  file << "  tree_end_entry_ = 0;\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Get settings of the TTreeCache\n\n";
+
+  file << "  \\return Settings, or null if ROOT's defaults are used\n";
+  file << "*/\n";
+  file << "const shared_ptr<const Baby::CacheOptions> & Baby::GetCacheOptions() const{\n";
+  file << "  return cache_options_;\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Set size, learning window, cached branches, and prefetching of the\n";
+  file << "  TTreeCache\n\n";
+
+  file << "  Takes effect the next time the chain opens a file.\n\n";
+
+  file << "  \\param[in] options Settings of the cache\n";
+  file << "*/\n";
+  file << "void Baby::SetCacheOptions(const CacheOptions &options){\n";
+  file << "  cache_options_ = make_shared<CacheOptions>(options);\n";
+  file << "  bulk_read_ = options.bulk_read_;\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Keep the values of some branches in memory for later passes over the\n";
+  file << "  entries\n\n";
+
+  file << "  Values are stored the first time they are read, and later reads of the same\n";
+  file << "  entry do not touch the branch. Only double, float, int32_t, and bool branches\n";
+  file << "  are kept, and only while the columns of all Babies fit in max_megabytes. Must\n";
+  file << "  be called before the clones reading the entries are activated. See\n";
+  file << "  ColumnCache.\n\n";
+
+  file << "  \\param[in] branches Names of the branches to keep\n\n";
+
+  file << "  \\param[in] num_entries Number of entries in the TChain\n\n";
+
+  file << "  \\param[in] max_megabytes Maximum memory used by the columns of all Babies\n";
+  file << "*/\n";
+  file << "void Baby::CacheColumns(const set<string> &branches, long num_entries, double max_megabytes){\n";
+  file << "  if(!column_cache_) column_cache_ = make_shared<ColumnCache>(num_entries);\n";
+  file << "  AddColumns(branches, max_megabytes);\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Get branches whose values the ColumnCache already holds for the\n";
+  file << "  given entries\n\n";
+
+  file << "  Must not be called while clones of this Baby are reading entries.\n\n";
+
+  file << "  \\param[in] entries Sorted entries that will be read, or null for every entry\n\n";
+
+  file << "  \\return Names of the branches served from memory\n";
+  file << "*/\n";
+  file << "set<string> Baby::FilledColumns(const vector<long> *entries) const{\n";
+  file << "  if(!column_cache_) return set<string>();\n";
+  file << "  return column_cache_->FilledColumns(entries);\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Get reading statistics of every file opened since Activate()\n\n";
+
+  file << "  \\return Statistics of each file, in the order they were read\n";
+  file << "*/\n";
+  file << "vector<Baby::ReadStats> Baby::GetReadStats() const{\n";
+  file << "  lock_guard<mutex> lock(Multithreading::root_mutex);\n";
+  file << "  vector<ReadStats> stats = read_stats_;\n";
+  file << "  if(chain_ && tree_end_entry_ > tree_first_entry_) stats.push_back(CurrentReadStats());\n";
+  file << "  return stats;\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Apply the cache settings and enabled branches to the file just\n";
+  file << "  opened by the chain\n\n";
+
+  file << "  Branches mapped from the column files of this file are disabled and left\n";
+  file << "  out of the TTreeCache, since their accessors never read them.\n\n";
+
+  file << "  Must be called with Multithreading::root_mutex locked, after\n";
+  file << "  OpenColumnFiles().\n";
+  file << "*/\n";
+  file << "void Baby::ConfigureCache(){\n";
+  file << "  auto is_mapped = [this](const string &branch){\n";
+  file << "    return column_files_ && column_files_->IsMapped(branch);\n";
+  file << "  };\n";
+  file << "  //Statuses persist across files, so mapped branches are re-enabled for files without columns\n";
+  file << "  if(enabled_branches_){\n";
+  file << "    for(const auto &branch: *enabled_branches_){\n";
+  file << "      chain_->SetBranchStatus(branch.c_str(), !is_mapped(branch));\n";
+  file << "    }\n";
+  file << "  }\n";
+  file << "  if(!cache_options_ && !enabled_branches_) return;\n";
+  file << "  CacheOptions options = cache_options_ ? *cache_options_ : CacheOptions();\n";
+  file << "  chain_->SetCacheSize(options.size_);\n";
+  file << "  if(options.size_ == 0) return;\n";
+  file << "  chain_->SetCacheLearnEntries(options.learn_entries_);\n";
+  file << "  set<string> branches = options.branches_;\n";
+  file << "  if(enabled_branches_) branches.insert(enabled_branches_->cbegin(), enabled_branches_->cend());\n";
+  file << "  for(auto branch = branches.begin(); branch != branches.end(); ){\n";
+  file << "    if(is_mapped(*branch)) branch = branches.erase(branch);\n";
+  file << "    else ++branch;\n";
+  file << "  }\n";
+  file << "  if(branches.empty()) return;\n";
+  file << "  //The cache is reset whenever the chain opens a new file\n";
+  file << "  for(const auto &branch: branches){\n";
+  file << "    chain_->AddBranchToCache(branch.c_str(), true);\n";
+  file << "  }\n";
+  file << "  chain_->StopCacheLearningPhase();\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Use the columns written by make_columns.exe for the file just\n";
+  file << "  opened by the chain, if they are up to date\n\n";
+
+  file << "  Must be called with Multithreading::root_mutex locked.\n";
+  file << "*/\n";
+  file << "void Baby::OpenColumnFiles(){\n";
+  file << "  column_files_.reset();\n";
+  file << "  TFile *tfile = chain_->GetCurrentFile();\n";
+  file << "  if(tfile != nullptr && tree_end_entry_ > tree_first_entry_){\n";
+  file << "    unique_ptr<ColumnFiles> columns(new ColumnFiles(tfile->GetName()));\n";
+  file << "    if(columns->NumEntries() == tree_end_entry_ - tree_first_entry_) column_files_ = move(columns);\n";
+  file << "  }\n";
+  file << "  MapColumns();\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Get reading statistics of the currently open file\n\n";
+
+  file << "  Must be called with Multithreading::root_mutex locked.\n\n";
+
+  file << "  \\return Statistics of the file\n";
+  file << "*/\n";
+  file << "Baby::ReadStats Baby::CurrentReadStats() const{\n";
+  file << "  ReadStats stats;\n";
+  file << "  TFile *tfile = chain_->GetCurrentFile();\n";
+  file << "  if(tfile == nullptr) return stats;\n";
+  file << "  stats.file_name_ = tfile->GetName();\n";
+  file << "  stats.read_calls_ = tfile->GetReadCalls();\n";
+  file << "  stats.bytes_read_ = tfile->GetBytesRead();\n";
+  file << "  TTreeCache *cache = chain_->GetReadCache(tfile);\n";
+  file << "  if(cache != nullptr) stats.cache_efficiency_ = cache->GetEfficiency();\n";
+  file << "  return stats;\n";
+  file << "}\n\n";
+
   file << "/*! \\brief Setup all branches\n";
   file << "*/\n";
   file << "void Baby::Initialize(){\n";
@@ -843,6 +1217,39 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
   file << "void Baby::DeactivateChain(){\n";
   file << "  lock_guard<mutex> lock(Multithreading::root_mutex);\n";
   file << "  chain_.reset();\n";
+  file << "  enabled_branches_.reset();\n";
+  file << "  read_stats_.clear();\n";
+  file << "  column_files_.reset();\n";
+  file << "  MapColumns();\n";
+  file << "  tree_first_entry_ = 0;\n";
+  file << "  tree_end_entry_ = 0;\n";
+  file << "  ++epoch_;\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Get counter identifying the currently loaded entry\n\n";
+
+  file << "  Changes every time Baby::GetEntry is called, so variables read by the\n";
+  file << "  accessors and results stored with GetCachedResult() are valid only while\n";
+  file << "  their epoch matches.\n\n";
+
+  file << "  \\return Current epoch\n";
+  file << "*/\n";
+  file << "long Baby::Epoch() const{\n";
+  file << "  return epoch_;\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Get storage for the per-event result of a shared NamedFunc expression\n\n";
+
+  file << "  The reference is invalidated when a larger slot is requested, so it should\n";
+  file << "  not be held across the evaluation of other NamedFuncs.\n\n";
+
+  file << "  \\param[in] slot Index assigned to the expression by NamedFunc\n\n";
+
+  file << "  \\return Cached result for slot\n";
+  file << "*/\n";
+  file << "Baby::CachedResult & Baby::GetCachedResult(size_t slot) const{\n";
+  file << "  if(slot >= cached_results_.size()) cached_results_.resize(slot+1);\n";
+  file << "  return cached_results_[slot];\n";
   file << "}\n\n";
 
   for(const auto &var: vars){
@@ -852,11 +1259,7 @@ void WriteBaseSource(const set<Variable> &vars, const vector<string> &types){
     file << "  \\return " << var.Name() << " for current event\n";
     file << "*/\n";
     file << var.DecoratedType() << " const & Baby::" << var.Name() << "() const{\n";
-    file << "  if(!c_" << var.Name() << "_ && b_" << var.Name() << "_){\n";
-    file << "    b_" << var.Name() << "_->GetEntry(entry_);\n";
-    file << "    c_" << var.Name() << "_ = true;\n";
-    file << "  }\n";
-    file << "  return " << var.Name() << "_;\n";
+    WriteAccessorBody(file, var.Name(), var.Type());
     file << "}\n\n";
   }
   file << flush;
@@ -876,12 +1279,15 @@ void WriteSpecializedHeader(const set<Variable> &vars, const string &type, const
 
   file << "#include \"core/baby.hpp\"\n\n";
 
-  file << "class Baby_" << type << ": virtual public Baby{\n";
+  file << "class Baby_" << type << " final: public Baby{\n";
   file << "public:\n";
   file << "  explicit Baby_" << type << "(const std::set<std::string> &file_names, const std::set<const Process*> &processes = std::set<const Process*>{});\n";
   file << "  virtual ~Baby_" << type << "() = default;\n\n";
 
-  file << "  virtual void GetEntry(long entry);\n\n";
+  file << "  virtual std::unique_ptr<Baby> Clone() const;\n\n";
+  file << "  static constexpr std::size_t class_number_ = "
+       << (find(baby_types.cbegin(), baby_types.cend(), type) - baby_types.cbegin())
+       << ";//!<Value of TypeNumber() for this class\n\n";
   file << "  virtual void ActivateChain();\n";
 
   for(const auto &var: vars){
@@ -891,7 +1297,7 @@ void WriteSpecializedHeader(const set<Variable> &vars, const string &type, const
           if(var.Type(baby_type) =="") continue;
           string varname = var.Name() +  var.VarIndex(baby_type);          
           if(baby_type == type){
-            file << "  virtual " << var.DecoratedType(baby_type) << " const & " << varname << "() const;\n";
+            WriteInlineAccessor(file, varname, var.DecoratedType(baby_type));
           } else {
             file << "  __attribute__((noreturn)) virtual " << var.DecoratedType(baby_type)
               << " const & " << varname << "() const;\n";
@@ -899,7 +1305,7 @@ void WriteSpecializedHeader(const set<Variable> &vars, const string &type, const
         } // for baby_types        
       } else {
         if(var.ImplementIn(type)){
-          file << "  virtual " << var.DecoratedType() << " const & " << var.Name() << "() const;\n";
+          WriteInlineAccessor(file, var.Name(), var.DecoratedType());
         }else{
          file << "  __attribute__((noreturn)) virtual " << var.DecoratedType()
               << " const & " << var.Name() << "() const;\n";
@@ -918,25 +1324,48 @@ void WriteSpecializedHeader(const set<Variable> &vars, const string &type, const
   file << "  Baby_" << type << "(Baby_" << type << " &&) = delete;\n";
   file << "  Baby_" << type << "& operator=(Baby_" << type << " &&) = delete;\n";
 
-  file << "  virtual void Initialize();\n\n";
+  file << "  virtual void Initialize();\n";
+  file << "  virtual void AddColumns(const std::set<std::string> &branches, double max_megabytes);\n";
+  file << "  virtual void MapColumns();\n\n";
 
   for(const auto &var: vars){
     if(!var.ImplementIn(type)) continue;
-    string varname = var.Name();
-    if(var.MultipleTypes()) {
-      for(const auto &baby_type: baby_types){
-        if(baby_type == type) {
-          varname += var.VarIndex(baby_type);
-          break;
-        }
-      }
-    }
-    file << "  " << var.DecoratedType(type) << " "
+    file << "  void Read_" << MemberName(var, type) << "() const;\n";
+  }
+  file << "\n";
+
+  file << "  //Same layout as in Baby: stamps and values first, then branches, columns, and bulk buffers\n";
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type)) continue;
+    string varname = MemberName(var, type);
+    file << "  mutable long e_" << varname << "_;//!<Value of epoch_ when "
+         << varname << " was last read\n";
+    file << "  mutable " << var.DecoratedType(type) << " "
          << varname << "_;//!<Cached value of " << varname << '\n';
-    file << "  TBranch *b_" << varname << "_;\n//!<Branch from which "
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type)) continue;
+    string varname = MemberName(var, type);
+    file << "  TBranch *b_" << varname << "_;//!<Branch from which "
          << varname << " is read\n";
-    file << "  mutable bool c_" << varname << "_;//!<Flag if cached "
-         << varname << " up to date\n";
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    string varname = MemberName(var, type);
+    file << "  ColumnCache::Column<" << var.Type(type) << "> *column_" << varname
+         << "_;//!<Values of " << varname << " kept in memory. Null if not cached.\n";
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    string varname = MemberName(var, type);
+    file << "  const " << var.Type(type) << " *mapped_" << varname
+         << "_;//!<Values of " << varname << " in the column file of the current tree. Null if absent.\n";
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    string varname = MemberName(var, type);
+    file << "  mutable BulkBranch bulk_" << varname << "_;//!<Basket from which "
+         << varname << " is read in bulk\n";
   }
   file << "};\n\n";
 
@@ -944,6 +1373,42 @@ void WriteSpecializedHeader(const set<Variable> &vars, const string &type, const
   file.close();
 }
 
+/*!\brief Writes the out-of-line part of an accessor in a derived Baby class
+
+  \param[in,out] file Source file being written
+
+  \param[in] type Name of derived Baby class (basic, full, etc.)
+
+  \param[in] varname Name of the accessor
+
+  \param[in] var_type Type of the variable
+*/
+void WriteReadFunction(ofstream &file, const string &type, const string &varname,
+                       const string &var_type){
+  file << "/*!\\brief Read " << varname << " for current event and cache it\n";
+  file << "*/\n";
+  file << "void Baby_" << type << "::Read_" << varname << "() const{\n";
+  if(IsBulkType(var_type)){
+    file << "  if(mapped_" << varname << "_){\n";
+    file << "    " << varname << "_ = mapped_" << varname << "_[entry_];\n";
+    file << "    e_" << varname << "_ = epoch_;\n";
+    file << "    return;\n";
+    file << "  }\n";
+    file << "  if(column_" << varname << "_ && column_" << varname << "_->Read(tree_first_entry_+entry_, "
+         << varname << "_)){\n";
+    file << "    e_" << varname << "_ = epoch_;\n";
+    file << "    return;\n";
+    file << "  }\n";
+  }
+  file << "  if(!b_" << varname << "_) return;\n";
+  WriteBranchRead(file, varname, var_type, "  ");
+  if(IsBulkType(var_type)){
+    file << "  if(column_" << varname << "_) column_" << varname << "_->Write(tree_first_entry_+entry_, "
+         << varname << "_);\n";
+  }
+  file << "}\n\n";
+}
+
 /*!\brief Writes a derived Baby source file
 
   \param[in] vars All variables for all Baby classes, with type information
@@ -962,7 +1427,12 @@ void WriteSpecializedSource(const set<Variable> &vars, const string &type,
   file << "  cannot implement functions to get them, and derived classes must do the work.\n";
   file << "  This class implements getter functions for variables in the " << type << " format\n";
   file << "  ntuples, and dummy getters that throw an error for any variable not in " << type;
-  file << "  format ntuples.\n";
+  file << "  format ntuples.\n\n";
+
+  file << "  The class is final and only the check of each epoch stamp is defined in the\n";
+  file << "  header, so code that knows it holds a Baby_" << type << ", like CompiledFunction\n";
+  file << "  and JitFunction, calls the getters without virtual dispatch. NamedFuncs parsed\n";
+  file << "  from strings still go through the virtual getters of Baby.\n";
   file << "*/\n";
   file << "#include \"core/baby_" << type << ".hpp\"\n\n";
 
@@ -975,60 +1445,40 @@ void WriteSpecializedSource(const set<Variable> &vars, const string &type,
   file << "  \\param[in] file_names ntuple files to read from\n";
   file << "*/\n";
   file << "Baby_" << type << "::Baby_" << type << "(const set<string> &file_names, const set<const Process*> &processes):\n";
-  int implemented_here = 0;
-  for(const auto & var: vars){
-    if(var.ImplementIn(type)) ++implemented_here;
+  file << "  Baby(file_names, processes)";
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type)) continue;
+    string varname = MemberName(var, type);
+    file << ",\n  e_" << varname << "_(-1),\n";
+    file << "  " << varname << "_{}";
   }
-  if(implemented_here == 0){
-    file << "  Baby(file_names, processes){\n";
-  }else{
-    file << "  Baby(file_names, processes),\n";
-    set<Variable>::const_iterator last = vars.cend();
-    for(auto var = vars.cbegin(); var != vars.cend(); ++var){
-      if(var->ImplementIn(type)){
-        last = var;
-      }
-    }
-    for(auto var = vars.cbegin(); var != vars.cend(); ++var){
-      if(!var->ImplementIn(type)) continue;
-      string varname = var->Name();
-      if(var->MultipleTypes()) {
-        for(const auto &baby_type: baby_types){
-          if(baby_type == type) {
-            varname += var->VarIndex(baby_type);
-            break;
-          }
-        }
-      }
-      file << "  " << varname << "_{},\n";
-      file << "  b_" << varname << "_(nullptr),\n";
-      if(var != last){
-        file << "  c_" << varname << "_(false),\n";
-      }else{
-        file << "  c_" << varname << "_(false){\n";
-      }
-    } // for vars
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type)) continue;
+    file << ",\n  b_" << MemberName(var, type) << "_(nullptr)";
   }
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    file << ",\n  column_" << MemberName(var, type) << "_(nullptr)";
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    file << ",\n  mapped_" << MemberName(var, type) << "_(nullptr)";
+  }
+  file << "{\n";
+  file << "  type_number_ = class_number_;\n";
   file << "}\n\n";
 
-  file << "/*!\\brief Change current entry\n\n";
-  file << "  \\param[in] entry Entry number to load\n";
+  file << "/*!\\brief Get a new Baby reading the same files\n\n";
+  file << "  The copy owns its own TChain and cached values, so it can be read in\n";
+  file << "  parallel with this Baby.\n\n";
+  file << "  \\return Unactivated Baby_" << type << " with the same files, processes, cache settings, and\n";
+  file << "  column cache\n";
   file << "*/\n";
-  file << "void Baby_" << type << "::GetEntry(long entry){\n";
-  for(const auto &var: vars){
-    if(!var.ImplementIn(type)) continue;
-    string varname = var.Name();
-    if(var.MultipleTypes()) {
-      for(const auto &baby_type: baby_types){
-        if(baby_type == type) {
-          varname += var.VarIndex(baby_type);
-          break;
-        }
-      }
-    }
-    file << "  c_" << varname << "_ = false;\n";
-  }
-  file << "  Baby::GetEntry(entry);\n";
+  file << "unique_ptr<Baby> Baby_" << type << "::Clone() const{\n";
+  file << "  Baby_" << type << " *baby = new Baby_" << type << "(file_names_, processes_);\n";
+  file << "  if(GetCacheOptions()) baby->SetCacheOptions(*GetCacheOptions());\n";
+  file << "  baby->column_cache_ = column_cache_;\n";
+  file << "  return unique_ptr<Baby>(baby);\n";
   file << "}\n\n";
 
   file << "void Baby_" << type << "::ActivateChain(){\n";
@@ -1061,6 +1511,47 @@ void WriteSpecializedSource(const set<Variable> &vars, const string &type,
     file << "  chain_->SetBranchAddress(\"" << var.Name() << "\", &"
          << varname << "_, &b_" << varname << "_);\n";
   }
+  file << "  if(column_cache_){\n";
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    file << "    column_" << MemberName(var, type) << "_ = column_cache_->Find<" << var.Type(type)
+         << ">(\"" << var.Name() << "\");\n";
+  }
+  file << "  }\n";
+  file << "}\n\n";
+
+  file << "/*!\\brief Add a column for each cached branch of a type ColumnCache supports\n\n";
+
+  file << "  \\param[in] branches Names of the branches to keep\n\n";
+
+  file << "  \\param[in] max_megabytes Maximum memory used by the columns of all Babies\n";
+  file << "*/\n";
+  bool have_columns = false;
+  for(const auto &var: vars){
+    if(var.ImplementIn(type) && IsBulkType(var.Type(type))) have_columns = true;
+  }
+  if(have_columns){
+    file << "void Baby_" << type << "::AddColumns(const set<string> &branches, double max_megabytes){\n";
+  }else{
+    file << "void Baby_" << type << "::AddColumns(const set<string> &/*branches*/, double /*max_megabytes*/){\n";
+  }
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    file << "  if(branches.count(\"" << var.Name() << "\")) column_cache_->Add<" << var.Type(type)
+         << ">(\"" << var.Name() << "\", max_megabytes);\n";
+  }
+  file << "}\n\n";
+
+  file << "/*!\\brief Point the accessors to the column files of the current tree\n";
+  file << "*/\n";
+  file << "void Baby_" << type << "::MapColumns(){\n";
+  for(const auto &var: vars){
+    if(!var.ImplementIn(type) || !IsBulkType(var.Type(type))) continue;
+    string varname = MemberName(var, type);
+    file << "  mapped_" << varname << "_ = column_files_ ? static_cast<const " << var.Type(type)
+         << "*>(column_files_->Find(\"" << var.Name() << "\", \"" << var.Type(type) << "\", sizeof("
+         << var.Type(type) << "))) : nullptr;\n";
+  }
   file << "}\n";
 
   for(const auto &var: vars){
@@ -1069,17 +1560,7 @@ void WriteSpecializedSource(const set<Variable> &vars, const string &type,
         if(var.Type(baby_type) =="") continue;
         string varname = var.Name() +  var.VarIndex(baby_type);          
         if(baby_type == type){
-          file << "/*!\\brief Get " << varname << " for current event and cache it\n\n";
-
-          file << "  \\return " << varname << " for current event\n";
-          file << "*/\n";
-          file << var.DecoratedType(type) << " const & Baby_" << type << "::" << varname << "() const{\n";
-          file << "  if(!c_" << varname << "_ && b_" << varname << "_){\n";
-          file << "    b_" << varname << "_->GetEntry(entry_);\n";
-          file << "    c_" << varname << "_ = true;\n";
-          file << "  }\n";
-          file << "  return " << varname << "_;\n";
-          file << "}\n\n";
+          WriteReadFunction(file, type, varname, var.Type(type));
         } else {
           file << "/*!\\brief Dummy getter for " << varname << ". Throws error\n\n";
 
@@ -1093,17 +1574,7 @@ void WriteSpecializedSource(const set<Variable> &vars, const string &type,
       }
     } else {
       if(var.ImplementIn(type)){
-        file << "/*!\\brief Get " << var.Name() << " for current event and cache it\n\n";
-
-        file << "  \\return " << var.Name() << " for current event\n";
-        file << "*/\n";
-        file << var.DecoratedType(type) << " const & Baby_" << type << "::" << var.Name() << "() const{\n";
-        file << "  if(!c_" << var.Name() << "_ && b_" << var.Name() << "_){\n";
-        file << "    b_" << var.Name() << "_->GetEntry(entry_);\n";
-        file << "    c_" << var.Name() << "_ = true;\n";
-        file << "  }\n";
-        file << "  return " << var.Name() << "_;\n";
-        file << "}\n\n";
+        WriteReadFunction(file, type, var.Name(), var.Type(type));
       }else{
         file << "/*!\\brief Dummy getter for " << var.Name() << ". Throws error\n\n";
 
@@ -1120,3 +1591,141 @@ void WriteSpecializedSource(const set<Variable> &vars, const string &type,
   file << flush;
   file.close();
 }
+
+/*!\brief Collects candidate expressions for ahead-of-time compilation
+
+  Lines of .txt files are taken as expressions. From all other files, the
+  contents of every string literal are taken. Spaces are removed, as done by
+  FunctionParser. Most candidates (file names, labels, etc.) are later rejected
+  by CppExpression::Translate().
+
+  \param[in] files Text files and analysis source files to read
+
+  \return Expressions without spaces
+*/
+set<string> CollectExpressions(const vector<string> &files){
+  set<string> expressions;
+  for(const auto &file: files){
+    ifstream ifs(file);
+    if(!ifs.is_open()) ERROR("Could not open "+file);
+    bool is_list = file.size() >= 4 && file.substr(file.size()-4) == ".txt";
+    for(string line; getline(ifs, line); ){
+      if(is_list){
+        if(line.find('#') != string::npos) line = line.substr(0, line.find('#'));
+        line.erase(remove(line.begin(), line.end(), ' '), line.end());
+        if(line != "") expressions.insert(line);
+        continue;
+      }
+      for(size_t start = line.find('"'); start != string::npos; start = line.find('"', start+1)){
+        if(start > 0 && (line.at(start-1) == '\\' || line.at(start-1) == '\'')) continue;
+        size_t end = start+1;
+        while(end < line.size() && line.at(end) != '"'){
+          if(line.at(end) == '\\') ++end;
+          ++end;
+        }
+        if(end >= line.size()) break;
+        string literal = line.substr(start+1, end-start-1);
+        literal.erase(remove(literal.begin(), literal.end(), ' '), literal.end());
+        if(literal != "") expressions.insert(literal);
+        start = end;
+      }
+    }
+  }
+  return expressions;
+}
+
+/*!\brief Writes src/core/compiled_functions.cpp
+
+  The file is left untouched if its content would not change, so that editing
+  a script without changing its expressions does not rebuild the core library.
+
+  \param[in] vars All variables for all Baby classes, with type information
+
+  \param[in] types Names of derived Baby classes (basic, full, etc.)
+
+  \param[in] expressions Candidate expressions, without spaces
+*/
+void WriteCompiledFunctions(const set<Variable> &vars,
+                            const vector<string> &types,
+                            const set<string> &expressions){
+  map<string, map<string, string> > accessors;
+  for(const auto &type: types){
+    for(const auto &var: vars){
+      string var_type = var.Type(type);
+      if(var_type == "" || var_type.find("vector") != string::npos) continue;
+      string name = var.Name() + (var.MultipleTypes() ? var.VarIndex(type) : "");
+      accessors[type][name] = var_type;
+    }
+  }
+
+  ostringstream file;
+  file << "// Generated by generate_baby.exe from the expressions in the analysis code.\n";
+  file << "// Do not edit.\n\n";
+
+  file << "#include \"core/compiled_function.hpp\"\n\n";
+
+  file << "#include <cmath>\n\n";
+
+  for(const auto &type: types){
+    file << "#include \"core/baby_" << type << ".hpp\"\n";
+  }
+  file << "\n";
+
+  file << "using namespace std;\n\n";
+
+  vector<pair<string, vector<string> > > compiled;
+  file << "namespace{\n";
+  for(const auto &expression: expressions){
+    vector<string> implemented;
+    for(const auto &type: types){
+      string code;
+      string baby_class = "Baby_"+type;
+      const auto &type_accessors = accessors[type];
+      auto variable = [&type_accessors, &baby_class](const string &name, string &var_code){
+        if(type_accessors.find(name) == type_accessors.cend()) return false;
+        var_code = "static_cast<double>(baby."+baby_class+"::"+name+"())";
+        return true;
+      };
+      if(!CppExpression::Translate(expression, variable, code)) continue;
+      string func_name = "Function" + to_string(compiled.size()) + "_" + type;
+      file << "  //" << expression << "\n";
+      file << "  double " << func_name << "(const Baby &b){\n";
+      //Only called on babies of this type, whose final accessors can be inlined
+      file << "    const " << baby_class << " &baby = static_cast<const " << baby_class << " &>(b);\n";
+      file << "    return " << code << ";\n";
+      file << "  }\n\n";
+      implemented.push_back(type);
+    }
+    if(implemented.size() != 0) compiled.push_back(make_pair(expression, implemented));
+  }
+  file << "}\n\n";
+
+  file << "/*!\\brief Get all compiled functions\n\n";
+
+  file << "  \\return Compiled functions, one per expression\n";
+  file << "*/\n";
+  file << "const vector<CompiledFunction> & CompiledFunction::Registry(){\n";
+  file << "  static const vector<CompiledFunction> registry = {\n";
+  for(size_t ifunc = 0; ifunc < compiled.size(); ++ifunc){
+    file << "    CompiledFunction(\"" << compiled.at(ifunc).first << "\", {\n";
+    for(const auto &type: compiled.at(ifunc).second){
+      file << "        {Baby_" << type << "::class_number_, Function" << ifunc << "_" << type << "},\n";
+    }
+    file << "      }),\n";
+  }
+  file << "  };\n";
+  file << "  return registry;\n";
+  file << "}\n";
+
+  string path = "src/core/compiled_functions.cpp";
+  ifstream old_file(path);
+  ostringstream old_content;
+  old_content << old_file.rdbuf();
+  if(old_file && old_content.str() == file.str()){
+    cout << "Compiled expressions in " << path << " are up to date" << endl;
+    return;
+  }
+  ofstream out(path);
+  out << file.str() << flush;
+  cout << "Compiled " << compiled.size() << " expressions into " << path << endl;
+}
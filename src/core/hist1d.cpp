@@ -43,6 +43,7 @@
 #include "TMath.h"
 #include "TLine.h"
 #include "TLegendEntry.h"
+#include "TFile.h"
 
 #include "core/utilities.hpp"
 
@@ -141,41 +142,73 @@ Hist1D::SingleHist1D::SingleHist1D(const Hist1D &figure,
                                    const TH1D &hist, const NamedFunc &xvar, const NamedFunc &weight):
   FigureComponent(figure, process),
   raw_hist_(hist),
+  variation_hists_(),
   scaled_hist_(),
-  proc_and_hist_cut_(figure.cut_ && process->cut_),
+  hist_cut_(figure.cut_),
   xvar_(xvar),
   weight_(weight),
-  cut_vector_(),
-  wgt_vector_(),
-  val_vector_(){
+  shards_(),
+  sums_(*raw_hist_.GetXaxis()),
+  variation_sums_(raw_hist_.GetNcells(), 0){
   raw_hist_.Sumw2();
   scaled_hist_.Sumw2();
   raw_hist_.SetBinErrorOption(TH1::kPoisson);
   scaled_hist_.SetBinErrorOption(TH1::kPoisson);
 }
 
-void Hist1D::SingleHist1D::RecordEvent(const Baby &baby){
+/*!\brief Get functions evaluated by RecordEvent()
+
+  \return Cut, variable, weight, and weight variations
+*/
+vector<NamedFunc> Hist1D::SingleHist1D::GetFunctions() const{
+  vector<NamedFunc> funcs = {hist_cut_, xvar_, weight_};
+  if(NumVariations() > 0){
+    const Hist1D &stack = static_cast<const Hist1D&>(figure_);
+    funcs.insert(funcs.end(), stack.variations_.cbegin(), stack.variations_.cend());
+  }
+  return funcs;
+}
+
+/*!\brief Makes room for one partial histogram per entry range
+
+  Partial histograms are only allocated once their range records an event.
+
+  \param[in] num_shards Number of entry ranges that will be processed
+*/
+void Hist1D::SingleHist1D::ReserveShards(size_t num_shards){
+  shards_.clear();
+  shards_.resize(num_shards);
+  if(variation_sums_.NumVariations() != NumVariations()){
+    variation_sums_ = VariationSums(raw_hist_.GetNcells(), NumVariations());
+    variation_hists_.clear();
+  }
+}
+
+void Hist1D::SingleHist1D::RecordEvent(const Baby &baby,
+                                       const NamedFunc::VectorType *proc_cut_vector,
+                                       size_t ishard){
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) shard_ptr.reset(new Shard(*raw_hist_.GetXaxis(), variation_sums_.NumVariations()));
+  Shard &shard = *shard_ptr;
+
   size_t min_vec_size=0;
   bool have_vec = false;
 
-  const NamedFunc &cut = proc_and_hist_cut_;
-  if(cut.IsScalar()){
-    if(!cut.GetScalar(baby)) return;
-  }else{
-    cut_vector_ = cut.GetVector(baby);
-    if(!HavePass(cut_vector_)) return;
+  bool cut_is_vector = false;
+  if(!EvaluateCut(hist_cut_, baby, proc_cut_vector, shard.cut_vector_, cut_is_vector)) return;
+  if(cut_is_vector){
     have_vec = true;
-    min_vec_size = cut_vector_.size();
+    min_vec_size = shard.cut_vector_.size();
   }
   const NamedFunc &wgt = weight_;
   NamedFunc::ScalarType wgt_scalar = 0.;
   if(wgt.IsScalar()){
-    wgt_scalar = wgt.GetScalar(baby);
+    wgt_scalar = wgt.IsConstant() ? wgt.ConstantValue() : wgt.GetScalar(baby);
   }else{
-    wgt_vector_ = wgt.GetVector(baby);
-    if(!have_vec || wgt_vector_.size() < min_vec_size){
+    shard.wgt_vector_ = wgt.GetVector(baby);
+    if(!have_vec || shard.wgt_vector_.size() < min_vec_size){
       have_vec = true;
-      min_vec_size = wgt_vector_.size();
+      min_vec_size = shard.wgt_vector_.size();
     }
   }
 
@@ -184,24 +217,275 @@ void Hist1D::SingleHist1D::RecordEvent(const Baby &baby){
   if(val.IsScalar()){
     val_scalar = val.GetScalar(baby);
   }else{
-    val_vector_ = val.GetVector(baby);
-    if(!have_vec || val_vector_.size() < min_vec_size){
+    shard.val_vector_ = val.GetVector(baby);
+    if(!have_vec || shard.val_vector_.size() < min_vec_size){
       have_vec = true;
-      min_vec_size = val_vector_.size();
+      min_vec_size = shard.val_vector_.size();
+    }
+  }
+
+  // The cut and x are shared by all weight variations, which only add their
+  // products with the weight to the bin found for the nominal fill
+  bool vary = shard.variation_weights_.size() > 0;
+  if(vary){
+    const Hist1D &stack = static_cast<const Hist1D&>(figure_);
+    for(size_t ivar = 0; ivar < shard.variation_weights_.size(); ++ivar){
+      const NamedFunc &variation = stack.variations_[ivar];
+      shard.variation_weights_[ivar] = variation.IsConstant() ? variation.ConstantValue() : variation.GetScalar(baby);
     }
   }
 
   if(!have_vec){
-    raw_hist_.Fill(val_scalar, wgt_scalar);
+    int bin = shard.sums_.Fill(val_scalar, wgt_scalar);
+    if(vary) shard.variation_sums_.Fill(bin, wgt_scalar, shard.variation_weights_);
   }else{
     for(size_t i = 0; i < min_vec_size; ++i){
-      if(cut.IsVector() && !cut_vector_.at(i)) continue;
-      raw_hist_.Fill(val.IsScalar() ? val_scalar : val_vector_.at(i),
-                     wgt.IsScalar() ? wgt_scalar : wgt_vector_.at(i));
+      if(cut_is_vector && !shard.cut_vector_.at(i)) continue;
+      NamedFunc::ScalarType w = wgt.IsScalar() ? wgt_scalar : shard.wgt_vector_.at(i);
+      int bin = shard.sums_.Fill(val.IsScalar() ? val_scalar : shard.val_vector_.at(i), w);
+      if(vary) shard.variation_sums_.Fill(bin, w, shard.variation_weights_);
     }
   }
 }
 
+/*!\brief Adds the partial histogram of an entry range to the sums of the
+  component
+
+  The partial histogram is released afterwards.
+
+  \param[in] ishard Index of the entry range to merge
+*/
+void Hist1D::SingleHist1D::MergeShard(size_t ishard){
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) return;
+  sums_.Add(shard_ptr->sums_);
+  variation_sums_.Add(shard_ptr->variation_sums_);
+  shard_ptr.reset();
+}
+
+/*!\brief Adds the sums of all merged ranges to raw_hist_ and
+  variation_hists_
+
+  Called once before drawing, so that TH1D only sees the final sums.
+*/
+void Hist1D::SingleHist1D::UpdateRawHist(){
+  sums_.AddTo(raw_hist_);
+  sums_.Clear();
+  if(variation_hists_.size() != variation_sums_.NumVariations()){
+    TH1D empty(raw_hist_);
+    empty.Reset();
+    variation_hists_.assign(variation_sums_.NumVariations(), empty);
+  }
+  variation_sums_.AddTo(variation_hists_);
+  variation_sums_.Clear();
+}
+
+/*!\brief Get number of weight variations filled by this component
+
+  \return Number of Hist1D::variations_, or 0 for data
+*/
+size_t Hist1D::SingleHist1D::NumVariations() const{
+  if(process_->type_ == Process::Type::data) return 0;
+  return static_cast<const Hist1D&>(figure_).variations_.size();
+}
+
+/*!\brief Standard constructor
+
+  \param[in] axis Binning of the full histogram
+*/
+Hist1D::SingleHist1D::Accumulator::Accumulator(const TAxis &axis):
+  nbins_(axis.GetNbins()),
+  xmin_(axis.GetXmin()),
+  xmax_(axis.GetXmax()),
+  edges_(),
+  sumw_(axis.GetNbins()+2, 0.),
+  sumw2_(axis.GetNbins()+2, 0.),
+  entries_(0.),
+  tsumw_(0.),
+  tsumw2_(0.),
+  tsumwx_(0.),
+  tsumwx2_(0.){
+  if(axis.IsVariableBinSize()){
+    const TArrayD &edges = *axis.GetXbins();
+    edges_.assign(edges.GetArray(), edges.GetArray()+edges.GetSize());
+  }
+}
+
+/*!\brief Adds a value to its bin, finding the bin exactly as TAxis::FindFixBin
+  and updating the statistics as TH1D::Fill would
+
+  \param[in] x Value to fill
+
+  \param[in] w Weight of the fill
+
+  \return Bin filled, 0 for underflow and GetNbins()+1 for overflow
+*/
+int Hist1D::SingleHist1D::Accumulator::Fill(double x, double w){
+  entries_ += 1.;
+  int bin;
+  if(x < xmin_){
+    bin = 0;
+  }else if(!(x < xmax_)){
+    bin = nbins_+1;
+  }else if(edges_.empty()){
+    bin = 1 + static_cast<int>(nbins_*(x-xmin_)/(xmax_-xmin_));
+  }else{
+    bin = upper_bound(edges_.cbegin(), edges_.cend(), x) - edges_.cbegin();
+  }
+  sumw_[bin] += w;
+  sumw2_[bin] += w*w;
+  if(bin == 0 || bin > nbins_) return bin;
+  tsumw_ += w;
+  tsumw2_ += w*w;
+  tsumwx_ += w*x;
+  tsumwx2_ += w*x*x;
+  return bin;
+}
+
+/*!\brief Adds the sums of another accumulator with the same binning
+
+  \param[in] other Accumulator to add
+*/
+void Hist1D::SingleHist1D::Accumulator::Add(const Accumulator &other){
+  for(size_t bin = 0; bin < sumw_.size(); ++bin){
+    sumw_[bin] += other.sumw_[bin];
+    sumw2_[bin] += other.sumw2_[bin];
+  }
+  entries_ += other.entries_;
+  tsumw_ += other.tsumw_;
+  tsumw2_ += other.tsumw2_;
+  tsumwx_ += other.tsumwx_;
+  tsumwx2_ += other.tsumwx2_;
+}
+
+/*!\brief Adds the sums to a histogram with the same binning
+
+  Bin contents, errors, entries and statistics end up as if hist had been
+  filled directly.
+
+  \param[in,out] hist Histogram with Sumw2() enabled
+*/
+void Hist1D::SingleHist1D::Accumulator::AddTo(TH1D &hist) const{
+  if(entries_ == 0.) return;
+  double stats[TH1::kNstat];
+  hist.GetStats(stats);
+  TArrayD &sumw2 = *hist.GetSumw2();
+  for(int bin = 0; bin < hist.GetNcells(); ++bin){
+    hist.AddBinContent(bin, sumw_.at(bin));
+    sumw2[bin] += sumw2_.at(bin);
+  }
+  stats[0] += tsumw_;
+  stats[1] += tsumw2_;
+  stats[2] += tsumwx_;
+  stats[3] += tsumwx2_;
+  hist.PutStats(stats);
+  hist.SetEntries(hist.GetEntries()+entries_);
+}
+
+/*!\brief Resets all sums to zero
+*/
+void Hist1D::SingleHist1D::Accumulator::Clear(){
+  fill(sumw_.begin(), sumw_.end(), 0.);
+  fill(sumw2_.begin(), sumw2_.end(), 0.);
+  entries_ = 0.;
+  tsumw_ = 0.;
+  tsumw2_ = 0.;
+  tsumwx_ = 0.;
+  tsumwx2_ = 0.;
+}
+
+/*!\brief Standard constructor
+
+  \param[in] num_cells Number of bins, including under- and overflow
+
+  \param[in] num_variations Number of weight variations
+*/
+Hist1D::SingleHist1D::VariationSums::VariationSums(size_t num_cells, size_t num_variations):
+  num_variations_(num_variations),
+  sumw_(num_cells*num_variations, 0.),
+  sumw2_(num_cells*num_variations, 0.){
+}
+
+/*!\brief Adds the varied weights of a fill
+
+  The variations of a bin are contiguous, so the cost of each extra variation
+  is one multiplication and two additions.
+
+  \param[in] bin Bin found by Accumulator::Fill()
+
+  \param[in] w Nominal weight of the fill
+
+  \param[in] variation_weights Factors multiplying w for each variation
+*/
+void Hist1D::SingleHist1D::VariationSums::Fill(int bin, double w, const NamedFunc::VectorType &variation_weights){
+  double *sumw = sumw_.data()+bin*num_variations_;
+  double *sumw2 = sumw2_.data()+bin*num_variations_;
+  for(size_t ivar = 0; ivar < num_variations_; ++ivar){
+    double wvar = w*variation_weights[ivar];
+    sumw[ivar] += wvar;
+    sumw2[ivar] += wvar*wvar;
+  }
+}
+
+/*!\brief Adds the sums of another set of variations with the same binning
+
+  \param[in] other Sums to add
+*/
+void Hist1D::SingleHist1D::VariationSums::Add(const VariationSums &other){
+  for(size_t i = 0; i < sumw_.size(); ++i){
+    sumw_[i] += other.sumw_[i];
+    sumw2_[i] += other.sumw2_[i];
+  }
+}
+
+/*!\brief Adds the sums to one histogram per variation
+
+  Statistics are recomputed from the bin contents.
+
+  \param[in,out] hists Histograms with Sumw2() enabled, one per variation
+*/
+void Hist1D::SingleHist1D::VariationSums::AddTo(vector<TH1D> &hists) const{
+  for(size_t ivar = 0; ivar < num_variations_; ++ivar){
+    TH1D &hist = hists.at(ivar);
+    TArrayD &sumw2 = *hist.GetSumw2();
+    for(int bin = 0; bin < hist.GetNcells(); ++bin){
+      hist.AddBinContent(bin, sumw_.at(bin*num_variations_+ivar));
+      sumw2[bin] += sumw2_.at(bin*num_variations_+ivar);
+    }
+    hist.ResetStats();
+  }
+}
+
+/*!\brief Resets all sums to zero
+*/
+void Hist1D::SingleHist1D::VariationSums::Clear(){
+  fill(sumw_.begin(), sumw_.end(), 0.);
+  fill(sumw2_.begin(), sumw2_.end(), 0.);
+}
+
+/*!\brief Get number of weight variations
+
+  \return Number of variations
+*/
+size_t Hist1D::SingleHist1D::VariationSums::NumVariations() const{
+  return num_variations_;
+}
+
+/*!\brief Standard constructor
+
+  \param[in] axis Binning of the full histogram
+
+  \param[in] num_variations Number of weight variations
+*/
+Hist1D::SingleHist1D::Shard::Shard(const TAxis &axis, size_t num_variations):
+  sums_(axis),
+  variation_sums_(axis.GetNbins()+2, num_variations),
+  variation_weights_(num_variations, 0.),
+  cut_vector_(),
+  wgt_vector_(),
+  val_vector_(){
+}
+
 /*! Get the maximum of the histogram
 
   \param[in] max_bound Returns the highest bin content c satisfying
@@ -291,6 +575,7 @@ Hist1D::Hist1D(const Axis &xaxis, const NamedFunc &cut,
   ratio_numerator_(""),
   ratio_denominator_(""),
   plot_options_(plot_options),
+  variations_(),
   show_lumi_(false),
   add_legend_line_(),
   backgrounds_(),
@@ -366,6 +651,9 @@ Hist1D::Hist1D(const Axis &xaxis, const NamedFunc &cut,
 void Hist1D::Print(double luminosity,
                    const string &subdir){
   luminosity_ = luminosity;
+  for(auto &hist: backgrounds_) hist->UpdateRawHist();
+  for(auto &hist: signals_) hist->UpdateRawHist();
+  for(auto &hist: datas_) hist->UpdateRawHist();
   for(const auto &opt: plot_options_){
     this_opt_ = opt;
     this_opt_.MakeSane();
@@ -534,6 +822,10 @@ void Hist1D::Print(double luminosity,
       cout << " open " << full_name << endl;
     }
   }
+  if(variations_.size() > 0){
+    if(subdir != "") mkdir(("plots/"+subdir).c_str(), 0777);
+    WriteVariations(subdir != "" ? "plots/"+subdir+"/"+Name() : "plots/"+Name());
+  }
 }
 
 set<const Process*> Hist1D::GetProcesses() const{
@@ -635,6 +927,45 @@ Hist1D & Hist1D::ShowLumi(const bool &show_lumi){
   return *this;
 }
 
+/*!\brief Sets weight variations filled alongside the plotted histograms
+
+  Each variation multiplies the weight of every background and signal process,
+  and is filled into Hist1D::SingleHist1D::variation_hists_ reusing the cut
+  and x value of the nominal fill. The histograms are written next to the
+  plot, in a ROOT file ending in _variations.root.
+
+  \param[in] variations Scalar weight factors, eg one per PID or form-factor toy
+*/
+Hist1D & Hist1D::Variations(const vector<NamedFunc> &variations){
+  for(const auto &variation: variations){
+    if(!variation.IsScalar()) ERROR("Weight variation "+variation.Name()+" is not a scalar");
+  }
+  variations_ = variations;
+  return *this;
+}
+
+/*!\brief Writes the unscaled nominal and varied histograms of the MC
+  processes
+
+  \param[in] base_name Path of the plot, without extension
+*/
+void Hist1D::WriteVariations(const string &base_name) const{
+  string path = base_name+"_variations.root";
+  TFile file(path.c_str(), "recreate");
+  if(file.IsZombie()) ERROR("Could not create "+path);
+  for(const auto &hists: {&backgrounds_, &signals_}){
+    for(const auto &hist: *hists){
+      string name = CodeToPlainText(hist->process_->name_);
+      file.WriteTObject(&hist->raw_hist_, (name+"_nominal").c_str());
+      for(size_t ivar = 0; ivar < hist->variation_hists_.size(); ++ivar){
+        file.WriteTObject(&hist->variation_hists_.at(ivar), (name+"_var"+to_string(ivar)).c_str());
+      }
+    }
+  }
+  file.Close();
+  cout << " open " << path << endl;
+}
+
 /*!\brief Generates stacked and scaled histograms from unstacked and unscaled
   ones
 
@@ -1,5 +1,6 @@
 #include "core/hist2d.hpp"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -25,37 +26,59 @@ Hist2D::SingleHist2D::SingleHist2D(const Hist2D &figure,
                                    const TH2D &hist_template):
   FigureComponent(figure, process),
   clusterizer_(hist_template, 10000),
-  proc_and_hist_cut_(figure.cut_ && process->cut_),
-  cut_vector_(),
-  wgt_vector_(),
-  xval_vector_(),
-  yval_vector_(){
+  hist_cut_(figure.cut_),
+  x_edges_(figure.xaxis_.Bins()),
+  y_edges_(figure.yaxis_.Bins()),
+  shards_(){
 }
 
-void Hist2D::SingleHist2D::RecordEvent(const Baby &baby){
+/*!\brief Get functions evaluated by RecordEvent()
+
+  \return Cut, weight, and variables on both axes
+*/
+vector<NamedFunc> Hist2D::SingleHist2D::GetFunctions() const{
   const Hist2D& hist = static_cast<const Hist2D&>(figure_);
+  return {hist_cut_, hist.weight_, hist.xaxis_.var_, hist.yaxis_.var_};
+}
+
+/*!\brief Makes room for the fills of each entry range
+
+  \param[in] num_shards Number of entry ranges that will be processed
+*/
+void Hist2D::SingleHist2D::ReserveShards(size_t num_shards){
+  shards_.clear();
+  shards_.resize(num_shards);
+}
+
+void Hist2D::SingleHist2D::RecordEvent(const Baby &baby,
+                                       const NamedFunc::VectorType *proc_cut_vector,
+                                       size_t ishard){
+  const Hist2D& hist = static_cast<const Hist2D&>(figure_);
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr){
+    shard_ptr.reset(new Shard((x_edges_.size()+1)*(y_edges_.size()+1), clusterizer_.MaxPoints()));
+  }
+  Shard &shard = *shard_ptr;
+
   size_t min_vec_size=0;
   bool have_vec = false;
 
-  const NamedFunc &cut = proc_and_hist_cut_;
-  if(cut.IsScalar()){
-    if(!cut.GetScalar(baby)) return;
-  }else{
-    cut_vector_ = cut.GetVector(baby);
-    if(!HavePass(cut_vector_)) return;
+  bool cut_is_vector = false;
+  if(!EvaluateCut(hist_cut_, baby, proc_cut_vector, shard.cut_vector_, cut_is_vector)) return;
+  if(cut_is_vector){
     have_vec = true;
-    min_vec_size = cut_vector_.size();
+    min_vec_size = shard.cut_vector_.size();
   }
 
   const NamedFunc &wgt = hist.weight_;
   NamedFunc::ScalarType wgt_scalar = 0.;
   if(wgt.IsScalar()){
-    wgt_scalar = wgt.GetScalar(baby);
+    wgt_scalar = wgt.IsConstant() ? wgt.ConstantValue() : wgt.GetScalar(baby);
   }else{
-    wgt_vector_ = wgt.GetVector(baby);
-    if(!have_vec || wgt_vector_.size() < min_vec_size){
+    shard.wgt_vector_ = wgt.GetVector(baby);
+    if(!have_vec || shard.wgt_vector_.size() < min_vec_size){
       have_vec = true;
-      min_vec_size = wgt_vector_.size();
+      min_vec_size = shard.wgt_vector_.size();
     }
   }
 
@@ -64,10 +87,10 @@ void Hist2D::SingleHist2D::RecordEvent(const Baby &baby){
   if(xval.IsScalar()){
     xval_scalar = xval.GetScalar(baby);
   }else{
-    xval_vector_ = xval.GetVector(baby);
-    if(!have_vec || xval_vector_.size() < min_vec_size){
+    shard.xval_vector_ = xval.GetVector(baby);
+    if(!have_vec || shard.xval_vector_.size() < min_vec_size){
       have_vec = true;
-      min_vec_size = xval_vector_.size();
+      min_vec_size = shard.xval_vector_.size();
     }
   }
 
@@ -76,25 +99,106 @@ void Hist2D::SingleHist2D::RecordEvent(const Baby &baby){
   if(yval.IsScalar()){
     yval_scalar = yval.GetScalar(baby);
   }else{
-    yval_vector_ = yval.GetVector(baby);
-    if(!have_vec || yval_vector_.size() < min_vec_size){
+    shard.yval_vector_ = yval.GetVector(baby);
+    if(!have_vec || shard.yval_vector_.size() < min_vec_size){
       have_vec = true;
-      min_vec_size = yval_vector_.size();
+      min_vec_size = shard.yval_vector_.size();
     }
   }
 
   if(!have_vec){
-    clusterizer_.AddPoint(xval_scalar, yval_scalar, wgt_scalar);
+    Fill(shard, xval_scalar, yval_scalar, wgt_scalar);
   }else{
     for(size_t i = 0; i < min_vec_size; ++i){
-      if(cut.IsVector() && !cut_vector_.at(i)) continue;
-      clusterizer_.AddPoint(xval.IsScalar() ? xval_scalar : xval_vector_.at(i),
-                            yval.IsScalar() ? yval_scalar : yval_vector_.at(i),
-                            wgt.IsScalar() ? wgt_scalar : wgt_vector_.at(i));
+      if(cut_is_vector && !shard.cut_vector_.at(i)) continue;
+      Fill(shard,
+           xval.IsScalar() ? xval_scalar : shard.xval_vector_.at(i),
+           yval.IsScalar() ? yval_scalar : shard.yval_vector_.at(i),
+           wgt.IsScalar() ? wgt_scalar : shard.wgt_vector_.at(i));
     }
   }
 }
 
+/*!\brief Adds the fills of an entry range to the clusterizer
+
+  Ranges are merged in order, so the clusterizer ends up as if it had been
+  filled directly.
+
+  \param[in] ishard Index of the entry range to merge
+*/
+void Hist2D::SingleHist2D::MergeShard(size_t ishard){
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) return;
+  const Shard &shard = *shard_ptr;
+  clusterizer_.AddBinned(shard.sumw_, shard.sumw2_, shard.stats_, shard.entries_,
+                         shard.points_, shard.all_points_);
+  shard_ptr.reset();
+}
+
+/*!\brief Adds a point to the sums of an entry range, finding its bin as
+  TAxis::FindFixBin does for variable bins and updating the statistics as
+  TH2D::Fill would
+
+  The point is only kept individually while the range has no more than
+  Clusterizer::MaxPoints() of them, so memory is bounded by the binning.
+
+  \param[in,out] shard Sums of the entry range
+
+  \param[in] x Value on the x axis
+
+  \param[in] y Value on the y axis
+
+  \param[in] w Weight
+*/
+void Hist2D::SingleHist2D::Fill(Shard &shard, float x, float y, float w) const{
+  shard.entries_ += 1.;
+  size_t nx = x_edges_.size()-1, ny = y_edges_.size()-1;
+  size_t binx = upper_bound(x_edges_.cbegin(), x_edges_.cend(), x) - x_edges_.cbegin();
+  size_t biny = upper_bound(y_edges_.cbegin(), y_edges_.cend(), y) - y_edges_.cbegin();
+  size_t bin = binx + (nx+2)*biny;
+  shard.sumw_[bin] += w;
+  shard.sumw2_[bin] += static_cast<double>(w)*w;
+  if(binx != 0 && binx <= nx && biny != 0 && biny <= ny){
+    double dw = w, dx = x, dy = y;
+    shard.stats_[0] += dw;
+    shard.stats_[1] += dw*dw;
+    shard.stats_[2] += dw*dx;
+    shard.stats_[3] += dw*dx*dx;
+    shard.stats_[4] += dw*dy;
+    shard.stats_[5] += dw*dy*dy;
+    shard.stats_[6] += dw*dx*dy;
+  }
+
+  if(!shard.all_points_) return;
+  if(shard.max_points_ >= 0 && shard.points_.size() >= static_cast<size_t>(shard.max_points_)){
+    // The merged clusterizer would only keep the histogram anyway
+    shard.all_points_ = false;
+    vector<Clustering::Point>().swap(shard.points_);
+  }else{
+    shard.points_.emplace_back(x, y, w);
+  }
+}
+
+/*!\brief Standard constructor
+
+  \param[in] num_cells Number of bins, including under- and overflow
+
+  \param[in] max_points Maximum number of points of the clusterizer
+*/
+Hist2D::SingleHist2D::Shard::Shard(size_t num_cells, long max_points):
+  sumw_(num_cells, 0.),
+  sumw2_(num_cells, 0.),
+  stats_(),
+  entries_(0.),
+  points_(),
+  max_points_(max_points),
+  all_points_(true),
+  cut_vector_(),
+  wgt_vector_(),
+  xval_vector_(),
+  yval_vector_(){
+}
+
 Hist2D::Hist2D(const Axis &xaxis, const Axis &yaxis, const NamedFunc &cut,
                const std::vector<std::shared_ptr<Process> > &processes,
                const std::vector<PlotOpt> &plot_options):
@@ -0,0 +1,207 @@
+/*! \class JitFunction
+
+  \brief Version of a NamedFunc string compiled at run time
+
+  If NamedFunc::UseJit() is enabled, each string given to NamedFunc that was
+  not compiled ahead of time (see CompiledFunction) but is a scalar expression
+  of constants, Baby variables, and arithmetic, comparison, and logical
+  operators gets a JitFunction. Before its event loop starts, PlotMaker calls
+  JitFunction::CompileAll(), which translates every such expression into a C++
+  function calling the accessors of each Baby type directly and compiles it
+  with ACLiC. Compilation never happens while events are being processed:
+  for Baby types that were not compiled this way, for expressions ACLiC fails
+  to compile, and when the functions are evaluated outside PlotMaker, NamedFunc
+  keeps using the closures built by FunctionParser.
+
+  The generated source and shared library are kept in
+  JitFunction::CacheDirectory(), named after a hash of the expression and Baby
+  type. Later runs find the library already built and only need to load it, so
+  the compilation cost is paid once per distinct string. Identical strings
+  within a run share a single JitFunction.
+
+  The executables are linked with -rdynamic so that the loaded libraries can
+  call the Baby accessors defined in them.
+*/
+#include "core/jit_function.hpp"
+
+#include <cctype>
+#include <cstdlib>
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <typeinfo>
+
+#include <cxxabi.h>
+
+#include "TSystem.h"
+
+#include "core/baby.hpp"
+#include "core/cpp_expression.hpp"
+#include "core/utilities.hpp"
+
+using namespace std;
+
+namespace{
+  mutex jit_mutex;//!<Protects the JitFunction instances and compilation of new types
+  map<string, shared_ptr<const JitFunction> > instances;//!<JitFunction of each expression, keyed by expression
+  string cache_directory = "bin/jit";//!<Location of generated sources and libraries
+
+  /*!\brief Get demangled name of a type
+
+    \param[in] type Type to name
+
+    \return Name as written in C++ code
+  */
+  string ClassName(const type_info &type){
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    if(demangled == nullptr) return type.name();
+    string name = demangled;
+    free(demangled);
+    return name;
+  }
+}
+
+/*!\brief Get JitFunction for an expression, shared by all NamedFuncs built from
+  the same string
+
+  \param[in] expression String as given to NamedFunc. Spaces are ignored.
+
+  \return JitFunction, or null if the expression cannot be translated to C++
+*/
+shared_ptr<const JitFunction> JitFunction::Find(const string &expression){
+  string stripped = CopyReplaceAll(expression, " ", "");
+  auto any_variable = [](const string &name, string &code){code = name; return true;};
+  string code;
+  if(!CppExpression::Translate(stripped, any_variable, code)) return nullptr;
+
+  lock_guard<mutex> lock(jit_mutex);
+  auto &instance = instances[stripped];
+  if(!instance) instance.reset(new JitFunction(stripped));
+  return instance;
+}
+
+/*!\brief Get directory holding the generated sources and libraries
+
+  \return Directory, relative to the working directory unless absolute
+*/
+const string & JitFunction::CacheDirectory(){
+  return cache_directory;
+}
+
+/*!\brief Set directory holding the generated sources and libraries
+
+  Must be set before the first JitFunction is evaluated.
+
+  \param[in] directory Directory, relative to the working directory unless
+  absolute
+*/
+void JitFunction::CacheDirectory(const string &directory){
+  cache_directory = directory;
+}
+
+/*!\brief Get expression implemented by this function
+
+  \return Expression without spaces
+*/
+const string & JitFunction::Expression() const{
+  return expression_;
+}
+
+/*!\brief Compile every expression seen so far for the types of the given
+  Babies
+
+  Holds the ROOT lock for the whole ACLiC build, so must not be called while
+  other threads are processing events. Types already compiled are skipped.
+
+  \param[in] babies Babies the functions will be evaluated on
+*/
+void JitFunction::CompileAll(const vector<Baby*> &babies){
+  lock_guard<mutex> lock(jit_mutex);
+  for(const auto &instance: instances){
+    for(const auto &baby: babies){
+      instance.second->Compile(*baby);
+    }
+  }
+}
+
+/*!\brief Get compiled function for the type of b
+
+  Never compiles nor locks, so it is safe to call from the event loop.
+
+  \param[in] b Baby the function will be evaluated on
+
+  \return Compiled function, or nullptr if the expression was not compiled for
+  this Baby type by CompileAll(), or could not be
+*/
+JitFunction::Pointer JitFunction::Get(const Baby &b) const{
+  size_t type = b.TypeNumber();
+  if(type >= functions_.size()) return nullptr;
+  return functions_[type].load(memory_order_acquire);
+}
+
+/*!\brief Standard constructor
+
+  \param[in] expression Expression without spaces
+*/
+JitFunction::JitFunction(const string &expression):
+  expression_(expression),
+  compiled_(Baby::num_types_, false),
+  functions_(Baby::num_types_){
+  for(auto &function: functions_) function.store(nullptr, memory_order_relaxed);
+}
+
+/*!\brief Compile the expression for the type of b and publish it for Get()
+
+  Must be called with jit_mutex held.
+
+  \param[in] b Baby the function will be evaluated on
+*/
+void JitFunction::Compile(const Baby &b) const{
+  size_t type = b.TypeNumber();
+  if(type >= compiled_.size() || compiled_[type]) return;
+  compiled_[type] = true;
+
+  Pointer function = nullptr;
+  string class_name = ClassName(typeid(b));
+  string code;
+  auto variable = [&class_name](const string &name, string &var_code){
+    var_code = "static_cast<double>(baby."+class_name+"::"+name+"())";
+    return true;
+  };
+  if(StartsWith(class_name, "Baby_")
+     && CppExpression::Translate(expression_, variable, code)){
+    string symbol = "plot_scripts_jit_"+HashString(expression_+"|"+class_name);
+    string path = cache_directory+"/"+symbol+".cxx";
+    string header = class_name;
+    for(auto &c: header) c = tolower(c);
+
+    lock_guard<mutex> root_lock(Multithreading::root_mutex);
+    static bool include_path_set = false;
+    if(!include_path_set){
+      gSystem->AddIncludePath(("-I"+string(gSystem->WorkingDirectory())+"/inc").c_str());
+      include_path_set = true;
+    }
+    gSystem->mkdir(cache_directory.c_str(), true);
+    if(!FileExists(path)){
+      //Sources are never rewritten, so ACLiC reuses the library from earlier runs
+      ofstream file(path);
+      file << "// " << expression_ << " for " << class_name << ", generated by JitFunction\n\n"
+           << "#include <cmath>\n\n"
+           << "#include \"core/" << header << ".hpp\"\n\n"
+           << "extern \"C\" double " << symbol << "(const Baby &b){\n"
+           << "  const " << class_name << " &baby = static_cast<const " << class_name << " &>(b);\n"
+           << "  return " << code << ";\n"
+           << "}\n";
+    }
+    if(gSystem->CompileMacro(path.c_str(), "kOs")){
+      function = reinterpret_cast<Pointer>(gSystem->DynFindSymbol("*", symbol.c_str()));
+    }
+    if(function == nullptr){
+      DBG("Could not compile "+expression_+" for "+class_name+". Using FunctionParser instead.");
+    }
+  }
+
+  functions_[type].store(function, memory_order_release);
+}
@@ -0,0 +1,225 @@
+// Writes uncompressed copies of the numeric branches of ntuples, read by the
+// Baby classes through mmap (see ColumnFiles)
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "TError.h" // Controls error level reporting
+#include "TFile.h"
+#include "TLeaf.h"
+#include "TSystem.h"
+#include "TTree.h"
+
+#include "core/column_files.hpp"
+#include "core/utilities.hpp"
+
+using namespace std;
+
+namespace{
+  string baby_type = "run2_std";
+  string branch_list = "";
+  vector<string> file_patterns;
+
+  //!Branch being copied and the file receiving its values
+  struct OutputColumn{
+    string name_;//!<Name of the branch
+    string type_;//!<Type of the branch, as in txt/variables
+    size_t size_;//!<Size in bytes of each value
+    double value_;//!<Address given to the branch. A double is large and aligned enough for every type.
+    unique_ptr<ofstream> file_;//!<Column file being written
+  };
+}
+
+void GetOptions(int argc, char *argv[]);
+
+/*!\brief Get size of a type supported by ColumnFiles
+
+  \param[in] type Type as in txt/variables
+
+  \return Size in bytes, or 0 if the type cannot be stored
+*/
+size_t TypeSize(const string &type){
+  if(type == "double") return sizeof(double);
+  if(type == "float") return sizeof(float);
+  if(type == "int32_t") return sizeof(int32_t);
+  if(type == "bool") return sizeof(bool);
+  return 0;
+}
+
+/*!\brief Get the ROOT name of a type supported by ColumnFiles
+
+  \param[in] type Type as in txt/variables
+
+  \return Type name given by TLeaf::GetTypeName, or empty if the type cannot be stored
+*/
+string LeafTypeName(const string &type){
+  if(type == "double") return "Double_t";
+  if(type == "float") return "Float_t";
+  if(type == "int32_t") return "Int_t";
+  if(type == "bool") return "Bool_t";
+  return "";
+}
+
+/*!\brief Read tree name and variable types of a Baby type
+
+  \param[in] path Path to txt/variables/<type>
+
+  \param[out] tree_name Name of the TTree in the ntuples
+
+  \return Type of each variable
+*/
+map<string, string> ReadVariables(const string &path, string &tree_name){
+  ifstream file(path);
+  if(!file) ERROR("Could not open "+path);
+  map<string, string> types;
+  string line;
+  while(getline(file, line)){
+    line = Strip(line);
+    if(line == "" || line.at(0) == '#') continue;
+    size_t colon = line.find(':');
+    if(colon == string::npos) continue;
+    string name = Strip(line.substr(0, colon));
+    string type = Strip(line.substr(colon+1));
+    if(type == "") tree_name = name;
+    else types[name] = type;
+  }
+  return types;
+}
+
+/*!\brief Write the selected branches of one ntuple
+
+  \param[in] path Path to the ntuple
+
+  \param[in] tree_name Name of the TTree
+
+  \param[in] types Type of each branch to write
+
+  \return Number of entries written
+*/
+long WriteColumns(const string &path, const string &tree_name, const map<string, string> &types){
+  TFile file(path.c_str(), "read");
+  TTree *tree = file.IsZombie() ? nullptr : dynamic_cast<TTree*>(file.Get(tree_name.c_str()));
+  if(tree == nullptr) ERROR("Could not find tree "+tree_name+" in "+path);
+
+  string directory = ColumnFiles::Directory(path);
+  gSystem->mkdir(directory.c_str(), true);
+  //The old manifest would validate partially rewritten columns
+  remove((directory+"/manifest.txt").c_str());
+
+  vector<OutputColumn> columns;
+  map<string, string> written;
+  tree->SetBranchStatus("*", false);
+  for(const auto &type: types){
+    if(tree->GetBranch(type.first.c_str()) == nullptr) continue;
+    //The branch is read as stored, so a column of another type would hold garbage
+    const TLeaf *leaf = tree->GetLeaf(type.first.c_str());
+    string leaf_type = leaf == nullptr ? "" : leaf->GetTypeName();
+    if(leaf_type != LeafTypeName(type.second)){
+      cout << "Skipping " << type.first << " in " << path << ": stored as "
+           << (leaf_type == "" ? "a non-scalar branch" : leaf_type) << ", not " << type.second << endl;
+      continue;
+    }
+    columns.push_back(OutputColumn{type.first, type.second, TypeSize(type.second), 0.,
+          unique_ptr<ofstream>(new ofstream(ColumnFiles::ColumnPath(path, type.first), ios::binary))});
+    written[type.first] = type.second;
+  }
+  //Addresses are set after the vector stops growing
+  for(auto &column: columns){
+    tree->SetBranchStatus(column.name_.c_str(), true);
+    if(tree->SetBranchAddress(column.name_.c_str(), static_cast<void*>(&column.value_)) < 0){
+      ERROR("Could not read branch "+column.name_+" of "+path+" as "+column.type_);
+    }
+  }
+
+  long num_entries = tree->GetEntries();
+  for(long entry = 0; entry < num_entries; ++entry){
+    tree->GetEntry(entry);
+    for(auto &column: columns){
+      column.file_->write(reinterpret_cast<const char*>(&column.value_), column.size_);
+    }
+  }
+  for(auto &column: columns){
+    column.file_->close();
+    if(!*column.file_) ERROR("Could not write "+ColumnFiles::ColumnPath(path, column.name_));
+  }
+  tree->ResetBranchAddresses();
+  ColumnFiles::WriteManifest(path, num_entries, written);
+  cout << "Wrote " << columns.size() << " columns with " << num_entries << " entries for "
+       << path << " into " << directory << endl;
+  return num_entries;
+}
+
+int main(int argc, char *argv[]){
+  gErrorIgnoreLevel=6000; // Turns off ROOT errors due to missing branches
+  GetOptions(argc, argv);
+  if(file_patterns.size() == 0) ERROR("No ntuples given. Usage: make_columns.exe [-t type] [-b branch1,branch2] [-d dir] files");
+
+  string tree_name = "";
+  map<string, string> all_types = ReadVariables("txt/variables/"+baby_type, tree_name);
+  set<string> selected;
+  for(const auto &branch: Tokenize(branch_list, ",")){
+    if(Strip(branch) != "") selected.insert(Strip(branch));
+  }
+
+  map<string, string> types;
+  for(const auto &type: all_types){
+    if(TypeSize(type.second) == 0) continue;
+    if(selected.size() != 0 && selected.find(type.first) == selected.cend()) continue;
+    types.insert(type);
+  }
+  for(const auto &branch: selected){
+    if(types.find(branch) == types.cend()){
+      cout << "Skipping " << branch << ": not a double, float, int32_t, or bool variable of "
+           << baby_type << " babies" << endl;
+    }
+  }
+
+  for(const auto &pattern: file_patterns){
+    for(const auto &path: Glob(pattern)){
+      WriteColumns(path, tree_name, types);
+    }
+  }
+}
+
+void GetOptions(int argc, char *argv[]){
+  while(true){
+    static struct option long_options[] = {
+      {"type", required_argument, 0, 't'},      // Baby type, as in txt/variables
+      {"branches", required_argument, 0, 'b'},  // Comma separated branches to write. All if empty.
+      {"directory", required_argument, 0, 'd'}, // Where to write the columns
+      {0, 0, 0, 0}
+    };
+
+    char opt = -1;
+    int option_index;
+    opt = getopt_long(argc, argv, "t:b:d:", long_options, &option_index);
+    if(opt == -1) break;
+
+    switch(opt){
+    case 't':
+      baby_type = optarg;
+      break;
+    case 'b':
+      branch_list = optarg;
+      break;
+    case 'd':
+      ColumnFiles::CacheDirectory(optarg);
+      break;
+    default:
+      printf("Bad option! getopt_long returned character code 0%o\n", opt);
+      break;
+    }
+  }
+  for(int argi = optind; argi < argc; ++argi) file_patterns.push_back(argv[argi]);
+}
@@ -38,16 +38,63 @@
   extra vectors being constructed (and often copied if care is not taken with
   results) even when evaluating a simple scalar value.
 
+  Besides its name, each NamedFunc may carry a canonical key describing the
+  expression it evaluates. Constants, Baby variables, and every NamedFunc built
+  from keyed operands receive one automatically; custom functions only if set
+  with NamedFunc::Key(). All \link NamedFunc NamedFuncs\endlink with the same
+  key share one set of functions, whose result is stored in the Baby the first
+  time it is needed for each event. A subexpression like "mu_PT/1000" appearing
+  in many cuts, weights, and plotted variables is thus evaluated once per event.
+
+  Every NamedFunc also keeps a Bytecode version of its function, built
+  alongside the closures by the same operators. If NamedFunc::UseBytecode() is
+  enabled before constructing \link NamedFunc NamedFuncs\endlink, their
+  functions run the flat Bytecode instead of the closure tree. Shared
+  subexpressions are then no longer cached, so it pays off mostly for long
+  cuts built from simple variables.
+
+  \link NamedFunc NamedFuncs\endlink built from numbers, or from strings
+  that FunctionParser reduces to a number, report NamedFunc::IsConstant(), so
+  figures can use NamedFunc::ConstantValue() instead of calling the function
+  for every event.
+
+  Baby variables know the branch they read, and the operators combine the
+  branches of their operands, so NamedFunc::Branches() lists every branch an
+  expression depends on. PlotMaker uses it to read only those branches. Custom
+  functions have unknown dependencies unless declared with
+  NamedFunc::Branches(), in which case all branches are read.
+
+  If the string given to the constructor was compiled ahead of time (see
+  CompiledFunction), the compiled version is used whenever available for the
+  type of Baby being evaluated.
+
+  Otherwise, if NamedFunc::UseJit() is enabled, the string is compiled at run
+  time (see JitFunction) for each type of Baby before PlotMaker processes any
+  event.
+
   \see FunctionParser for allowed expression syntax for constructing a
   NamedFunc.
 */
 #include "core/named_func.hpp"
 
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
 #include <utility>
 
 #include "core/utilities.hpp"
 #include "core/function_parser.hpp"
+#include "core/compiled_function.hpp"
+#include "core/jit_function.hpp"
 
 using namespace std;
 
@@ -57,6 +104,269 @@ using ScalarFunc = NamedFunc::ScalarFunc;
 using VectorFunc = NamedFunc::VectorFunc;
 
 namespace{
+  /*!\brief Functions shared by all \link NamedFunc NamedFuncs\endlink with the
+    same key
+  */
+  struct SharedExpression{
+    function<ScalarFunc> scalar_func_;//!<Shared scalar function, possibly caching its result
+    function<VectorFunc> vector_func_;//!<Shared vector function, possibly caching its result
+  };
+
+  mutex expressions_mutex;//!<Protects expressions and num_slots
+  unordered_map<string, SharedExpression> expressions;//!<Shared functions indexed by key
+  size_t num_slots = 0;//!<Number of Baby::CachedResult slots handed out
+
+  bool use_bytecode = false;//!<Whether new NamedFuncs run their Bytecode instead of closures
+  bool use_jit = false;//!<Whether new NamedFuncs built from strings are compiled at run time
+  long adaptive_events = 0;//!<Number of events sampled before reordering "&&" and "||" chains. 0 to disable.
+
+  /*!\brief Get a functor evaluating f at most once per event
+
+    \param[in] slot Index of the Baby::CachedResult holding the result
+
+    \param[in] f Function which takes a Baby and returns a single value
+
+    \return Functor returning the result of f, computed only if not yet stored
+    in the Baby for the current entry
+  */
+  function<ScalarFunc> CacheResult(size_t slot, const function<ScalarFunc> &f){
+    return [slot,f](const Baby &b){
+      const Baby::CachedResult &cached = b.GetCachedResult(slot);
+      if(cached.epoch_ == b.Epoch()) return cached.scalar_;
+      ScalarType result = f(b);
+      //Evaluating f may have resized the cache, so fetch the slot again
+      Baby::CachedResult &stored = b.GetCachedResult(slot);
+      stored.epoch_ = b.Epoch();
+      stored.scalar_ = result;
+      return result;
+    };
+  }
+
+  /*!\brief Get a functor evaluating f at most once per event
+
+    \param[in] slot Index of the Baby::CachedResult holding the result
+
+    \param[in] f Function which takes a Baby and returns a vector of values
+
+    \return Functor returning the result of f, computed only if not yet stored
+    in the Baby for the current entry
+  */
+  function<VectorFunc> CacheResult(size_t slot, const function<VectorFunc> &f){
+    return [slot,f](const Baby &b){
+      const Baby::CachedResult &cached = b.GetCachedResult(slot);
+      if(cached.epoch_ == b.Epoch()) return cached.vector_;
+      VectorType result = f(b);
+      Baby::CachedResult &stored = b.GetCachedResult(slot);
+      stored.epoch_ = b.Epoch();
+      stored.vector_ = result;
+      return result;
+    };
+  }
+
+  /*!\brief Get key of the result of applying binary operator op to f and g
+
+    \param[in] f Left hand operand
+
+    \param[in] op String representation of the operator
+
+    \param[in] g Right hand operand
+
+    \return Key of the combined expression, or empty string if either operand
+    has no key
+  */
+  string CombineKeys(const NamedFunc &f, const string &op, const NamedFunc &g){
+    if(f.Key() == "" || g.Key() == "") return "";
+    return "(" + f.Key() + ")" + op + "(" + g.Key() + ")";
+  }
+
+  /*!\brief Get key of the result of applying unary operator op to f
+
+    \param[in] op String representation of the operator
+
+    \param[in] f Operand
+
+    \return Key of the combined expression, or empty string if f has no key
+  */
+  string CombineKeys(const string &op, const NamedFunc &f){
+    if(f.Key() == "") return "";
+    return op + "(" + f.Key() + ")";
+  }
+
+  /*!\brief Get union of two sets of branches
+
+    \param[in] f Branches of first operand
+
+    \param[in] g Branches of second operand
+
+    \return Union of f and g, or null if either is unknown
+  */
+  NamedFunc::BranchSet CombineBranches(const NamedFunc::BranchSet &f, const NamedFunc::BranchSet &g){
+    if(!f || !g) return nullptr;
+    if(f == g || g->empty()) return f;
+    if(f->empty()) return g;
+    auto branches = make_shared<set<string> >(*f);
+    branches->insert(g->cbegin(), g->cend());
+    return branches;
+  }
+
+  /*!\brief Get branches read by a function combining f and g
+
+    \param[in] f First operand
+
+    \param[in] g Second operand
+
+    \return Union of the branches of f and g, or null if either is unknown
+  */
+  NamedFunc::BranchSet CombineBranches(const NamedFunc &f, const NamedFunc &g){
+    return CombineBranches(f.Branches(), g.Branches());
+  }
+
+  /*!\brief Chain of scalar terms joined by "&&" or "||", evaluated in the
+    order expected to be cheapest
+
+    During the first adaptive_events evaluations, every term is evaluated and
+    its pass rate and time are recorded. The terms are then sorted by time per
+    decisive result, i.e. time/(1-pass rate) for "&&" and time/(pass rate) for
+    "||", and later evaluations short-circuit in that order. Terms containing a
+    subscript or without a key may rely on the terms before them (e.g.
+    "nmu>0&&mu_pt[0]>1"), so no term is moved across them.
+  */
+  class LogicChain{
+  public:
+    LogicChain(const vector<NamedFunc> &terms, bool is_and):
+      terms_(terms),
+      is_and_(is_and),
+      ordered_(false),
+      mutex_(),
+      num_sampled_(0),
+      num_evaluated_(terms.size(), 0),
+      num_pass_(terms.size(), 0),
+      time_ns_(terms.size(), 0.),
+      order_(terms.size()){
+      iota(order_.begin(), order_.end(), 0);
+    }
+
+    ScalarType Evaluate(const Baby &b){
+      if(ordered_.load(memory_order_acquire)){
+        for(const auto &iterm: order_){
+          if((terms_[iterm].GetScalar(b) != 0.) != is_and_) return !is_and_;
+        }
+        return is_and_;
+      }
+      return Sample(b);
+    }
+
+  private:
+    vector<NamedFunc> terms_;//!<Terms in source order
+    bool is_and_;//!<Whether terms are joined by "&&" rather than "||"
+    atomic<bool> ordered_;//!<Whether order_ is final
+    mutex mutex_;//!<Protects the sampling statistics
+    long num_sampled_;//!<Number of events sampled so far
+    vector<long> num_evaluated_;//!<Number of sampled evaluations of each term
+    vector<long> num_pass_;//!<Number of sampled evaluations in which each term was true
+    vector<double> time_ns_;//!<Total time spent evaluating each term
+    vector<size_t> order_;//!<Evaluation order, written once before ordered_ is set
+
+    static bool IsBarrier(const NamedFunc &term){
+      return term.Key() == "" || Contains(term.Key(), "[");
+    }
+
+    ScalarType Sample(const Baby &b){
+      using Clock = chrono::steady_clock;
+      vector<char> pass(terms_.size(), 0);
+      vector<double> time_ns(terms_.size(), -1.);
+      bool decided = false;
+      for(size_t iterm = 0; iterm < terms_.size(); ++iterm){
+        if(decided && IsBarrier(terms_[iterm])) break;
+        auto start = Clock::now();
+        pass[iterm] = terms_[iterm].GetScalar(b) != 0.;
+        time_ns[iterm] = chrono::duration<double, nano>(Clock::now() - start).count();
+        if(static_cast<bool>(pass[iterm]) != is_and_) decided = true;
+      }
+
+      lock_guard<mutex> lock(mutex_);
+      if(!ordered_.load(memory_order_relaxed)){
+        for(size_t iterm = 0; iterm < terms_.size(); ++iterm){
+          if(time_ns[iterm] < 0.) continue;
+          ++num_evaluated_[iterm];
+          if(pass[iterm]) ++num_pass_[iterm];
+          time_ns_[iterm] += time_ns[iterm];
+        }
+        if(++num_sampled_ >= adaptive_events){
+          Reorder();
+          ordered_.store(true, memory_order_release);
+        }
+      }
+      return decided ? !is_and_ : is_and_;
+    }
+
+    double Score(size_t iterm) const{
+      if(num_evaluated_[iterm] == 0) return numeric_limits<double>::max();
+      double rate = static_cast<double>(num_pass_[iterm])/num_evaluated_[iterm];
+      double decisive = is_and_ ? 1.-rate : rate;
+      double time = time_ns_[iterm]/num_evaluated_[iterm];
+      return decisive > 0. ? time/decisive : numeric_limits<double>::max();
+    }
+
+    void Reorder(){
+      auto first = order_.begin();
+      while(first != order_.end()){
+        auto last = first;
+        while(last != order_.end() && !IsBarrier(terms_[*last])) ++last;
+        stable_sort(first, last, [this](size_t a, size_t b){return Score(a) < Score(b);});
+        first = last == order_.end() ? last : last+1;
+      }
+
+      ostringstream oss;
+      oss << "Reordered " << (is_and_ ? "&&" : "||") << " chain after " << num_sampled_ << " events:\n"
+          << setw(10) << "Pass [%]" << setw(10) << "Time [ns]" << "  Term\n";
+      for(const auto &iterm: order_){
+        long num = num_evaluated_[iterm];
+        oss << fixed << setprecision(1)
+            << setw(10) << (num > 0 ? 100.*num_pass_[iterm]/num : 0.)
+            << setw(10) << (num > 0 ? time_ns_[iterm]/num : 0.)
+            << "  " << terms_[iterm].Name() << "\n";
+      }
+      cout << oss.str() << flush;
+    }
+  };
+
+  /*!\brief Get a NamedFunc joining scalar terms with "&&" or "||" in an
+    adaptive order
+
+    \param[in] terms Scalar terms in source order
+
+    \param[in] is_and Whether to join with "&&" rather than "||"
+
+    \return NamedFunc with the same name and Bytecode as the left associative
+    chain built by the binary operators. Its key is the key of that chain
+    prefixed with "adaptive:", so that it is shared only with other adaptive
+    chains and never swapped for (or swapped into) the plain closure.
+  */
+  NamedFunc MakeLogicChain(const vector<NamedFunc> &terms, bool is_and){
+    if(terms.size() == 0) ERROR("Cannot build a logical chain without terms");
+    for(const auto &term: terms){
+      if(!term.IsScalar()) ERROR("Cannot reorder vector term "+term.Name());
+    }
+    string op = is_and ? "&&" : "||";
+    string name = terms.front().Name();
+    string key = terms.front().Key();
+    Bytecode::Pointer code = terms.front().Code();
+    NamedFunc::BranchSet branches = terms.front().Branches();
+    for(size_t iterm = 1; iterm < terms.size(); ++iterm){
+      const NamedFunc &term = terms.at(iterm);
+      branches = CombineBranches(branches, term.Branches());
+      name = "(" + name + ")" + op + "(" + term.Name() + ")";
+      key = key == "" || term.Key() == "" ? "" : "(" + key + ")" + op + "(" + term.Key() + ")";
+      code = Bytecode::Apply(is_and ? Bytecode::Operator::logical_and : Bytecode::Operator::logical_or,
+                             code, term.Code());
+    }
+    shared_ptr<LogicChain> chain = make_shared<LogicChain>(terms, is_and);
+    NamedFunc result(name, [chain](const Baby &b){return chain->Evaluate(b);});
+    result.Key(key == "" ? "" : "adaptive:" + key).Code(code).Branches(branches);
+    return result;
+  }
+
   /*!\brief Get a functor applying unary operator op to f
 
     \param[in] f Function which takes a Baby and returns a single value
@@ -310,8 +620,13 @@ namespace{
 NamedFunc::NamedFunc(const std::string &name,
                      const std::function<ScalarFunc> &function):
   name_(name),
+  key_(),
   scalar_func_(function),
-  vector_func_(){
+  vector_func_(),
+  code_(Bytecode::Call(function)),
+  branches_(),
+  is_constant_(false),
+  constant_value_(0.){
   CleanName();
 }
 
@@ -324,8 +639,13 @@ NamedFunc::NamedFunc(const std::string &name,
 NamedFunc::NamedFunc(const std::string &name,
                      const std::function<VectorFunc> &function):
   name_(name),
+  key_(),
   scalar_func_(),
-  vector_func_(function){
+  vector_func_(function),
+  code_(Bytecode::Call(function)),
+  branches_(),
+  is_constant_(false),
+  constant_value_(0.){
   CleanName();
   }
 
@@ -337,6 +657,23 @@ NamedFunc::NamedFunc(const std::string &name,
 */
 NamedFunc::NamedFunc(const string &function):
   NamedFunc(FunctionParser(function).ResolveAsNamedFunc()){
+  if(!IsScalar() || IsConstant()) return;
+  std::function<ScalarFunc> fallback = scalar_func_;
+  const CompiledFunction *compiled = CompiledFunction::Find(function);
+  if(compiled != nullptr){
+    scalar_func_ = [compiled, fallback](const Baby &b){
+      CompiledFunction::Pointer compiled_func = compiled->Get(b);
+      return compiled_func != nullptr ? compiled_func(b) : fallback(b);
+    };
+    return;
+  }
+  if(!use_jit) return;
+  shared_ptr<const JitFunction> jit = JitFunction::Find(function);
+  if(!jit) return;
+  scalar_func_ = [jit, fallback](const Baby &b){
+    JitFunction::Pointer jit_func = jit->Get(b);
+    return jit_func != nullptr ? jit_func(b) : fallback(b);
+  };
 }
 
 /*!\brief Constructor using FunctionParser to produce a real function from a
@@ -365,8 +702,16 @@ NamedFunc::NamedFunc(const TString &function):
 */
 NamedFunc::NamedFunc(ScalarType x):
   name_(ToString(x)),
+  key_(),
   scalar_func_([x](const Baby&){return x;}),
-  vector_func_(){
+  vector_func_(),
+  code_(Bytecode::Constant(x)),
+  branches_(make_shared<set<string> >()),
+  is_constant_(true),
+  constant_value_(x){
+  ostringstream oss;
+  oss << hexfloat << x;
+  key_ = "#" + oss.str();
 }
 
 /*!\brief Get the string representation of this function
@@ -387,6 +732,58 @@ NamedFunc & NamedFunc::Name(const string &name){
   return *this;
 }
 
+/*!\brief Get the canonical key of this function
+
+  \return Key shared by all identical functions, or empty string if unknown
+*/
+const string & NamedFunc::Key() const{
+  return key_;
+}
+
+/*!\brief Set the canonical key of this function
+
+  The first NamedFunc given a key registers its functions, wrapped so that
+  their result is stored in the Baby once per event if cache_result is
+  true. Later \link NamedFunc NamedFuncs\endlink with the same key replace
+  their functions by the registered ones. It is the caller's responsibility
+  that the key identifies the expression uniquely.
+
+  \param[in] key Canonical representation of the function. An empty key
+  disables sharing. Keys starting with "#" are reserved for constants.
+
+  \param[in] cache_result Whether to store the result in the Baby for reuse
+  within the same event. Not worth it for functions that are cheap to
+  reevaluate, like reading a Baby variable.
+
+  \return Reference to *this
+*/
+NamedFunc & NamedFunc::Key(const string &key, bool cache_result){
+  key_ = key;
+  is_constant_ = StartsWith(key_, "#");
+  constant_value_ = is_constant_ ? strtod(key_.c_str()+1, nullptr) : 0.;
+  if(key_ == "") return *this;
+
+  lock_guard<mutex> lock(expressions_mutex);
+  auto found = expressions.find(key_);
+  if(found == expressions.end()){
+    SharedExpression expression;
+    if(cache_result){
+      size_t slot = num_slots++;
+      if(IsScalar()) expression.scalar_func_ = CacheResult(slot, scalar_func_);
+      if(IsVector()) expression.vector_func_ = CacheResult(slot, vector_func_);
+    }else{
+      expression.scalar_func_ = scalar_func_;
+      expression.vector_func_ = vector_func_;
+    }
+    found = expressions.emplace(key_, expression).first;
+  }else if(IsScalar() != static_cast<bool>(found->second.scalar_func_)){
+    ERROR("Function "+name_+" has the same key as a function of a different type: "+key_);
+  }
+  scalar_func_ = found->second.scalar_func_;
+  vector_func_ = found->second.vector_func_;
+  return *this;
+}
+
 /*!\brief Set function to given scalar function
 
   This function overwrites the scalar function and invalidates the vector
@@ -398,8 +795,12 @@ NamedFunc & NamedFunc::Name(const string &name){
 */
 NamedFunc & NamedFunc::Function(const std::function<ScalarFunc> &f){
   if(!static_cast<bool>(f)) return *this;
+  key_ = "";
+  branches_.reset();
+  is_constant_ = false;
   scalar_func_ = f;
   vector_func_ = function<VectorFunc>();
+  code_ = Bytecode::Call(f);
   return *this;
 }
 
@@ -414,8 +815,12 @@ NamedFunc & NamedFunc::Function(const std::function<ScalarFunc> &f){
 */
 NamedFunc & NamedFunc::Function(const std::function<VectorFunc> &f){
   if(!static_cast<bool>(f)) return *this;
+  key_ = "";
+  branches_.reset();
+  is_constant_ = false;
   scalar_func_ = function<ScalarFunc>();
   vector_func_ = f;
+  code_ = Bytecode::Call(f);
   return *this;
 }
 
@@ -435,6 +840,143 @@ const function<VectorFunc> & NamedFunc::VectorFunction() const{
   return vector_func_;
 }
 
+/*!\brief Return the (possibly null) Bytecode version of the function
+
+  \return Bytecode evaluating the same expression as *this
+*/
+const Bytecode::Pointer & NamedFunc::Code() const{
+  return code_;
+}
+
+/*!\brief Get names of the branches read by the function
+
+  \return Set of branch names, or null if unknown
+*/
+const NamedFunc::BranchSet & NamedFunc::Branches() const{
+  return branches_;
+}
+
+/*!\brief Declare the branches read by the function
+
+  Needed for custom functions to let PlotMaker skip unused branches.
+
+  \param[in] branches Names of all branches read by the function
+
+  \return Reference to *this
+*/
+NamedFunc & NamedFunc::Branches(const set<string> &branches){
+  branches_ = make_shared<set<string> >(branches);
+  return *this;
+}
+
+/*!\brief Set branches read by the function
+
+  \param[in] branches Names of all branches read by the function. Null if
+  unknown.
+
+  \return Reference to *this
+*/
+NamedFunc & NamedFunc::Branches(const BranchSet &branches){
+  branches_ = branches;
+  return *this;
+}
+
+/*!\brief Set Bytecode version of the function
+
+  If NamedFunc::UseBytecode() is enabled, the scalar or vector function is
+  replaced by one running code.
+
+  \param[in] code Bytecode evaluating the same expression as *this. Null if not
+  available.
+
+  \return Reference to *this
+*/
+NamedFunc & NamedFunc::Code(const Bytecode::Pointer &code){
+  code_ = code;
+  //A single instruction is just a call to the existing function
+  if(!use_bytecode || !code_ || code_->NumInstructions() <= 1) return *this;
+  Bytecode::Pointer program = code_;
+  if(program->IsScalar()){
+    scalar_func_ = [program](const Baby &b){
+      return program->GetScalar(b);
+    };
+    vector_func_ = function<VectorFunc>();
+  }else{
+    scalar_func_ = function<ScalarFunc>();
+    vector_func_ = [program](const Baby &b){
+      return program->GetVector(b);
+    };
+  }
+  return *this;
+}
+
+/*!\brief Check if new \link NamedFunc NamedFuncs\endlink run their Bytecode
+
+  \return True if functions built from now on use Bytecode
+*/
+bool NamedFunc::UseBytecode(){
+  return use_bytecode;
+}
+
+/*!\brief Select whether new \link NamedFunc NamedFuncs\endlink run their
+  Bytecode instead of the closure tree
+
+  Affects only \link NamedFunc NamedFuncs\endlink constructed afterwards, so it
+  should be set at the start of the program.
+
+  \param[in] use Whether to use Bytecode
+*/
+void NamedFunc::UseBytecode(bool use){
+  use_bytecode = use;
+}
+
+/*!\brief Check if new \link NamedFunc NamedFuncs\endlink built from strings
+  are compiled at run time
+
+  \return True if strings given to NamedFunc from now on are compiled with
+  JitFunction
+*/
+bool NamedFunc::UseJit(){
+  return use_jit;
+}
+
+/*!\brief Select whether new \link NamedFunc NamedFuncs\endlink built from
+  strings are compiled at run time
+
+  Strings already compiled ahead of time and vector expressions are not
+  affected. Affects only \link NamedFunc NamedFuncs\endlink constructed
+  afterwards.
+
+  \param[in] use Whether to compile strings with JitFunction
+*/
+void NamedFunc::UseJit(bool use){
+  use_jit = use;
+}
+
+/*!\brief Get number of events sampled before reordering "&&" and "||" chains
+
+  \return Number of sampled events, or 0 if chains are evaluated in source order
+*/
+long NamedFunc::AdaptiveLogic(){
+  return adaptive_events;
+}
+
+/*!\brief Select whether chains of "&&" and "||" in strings are reordered by
+  measured pass rate and cost
+
+  When enabled, FunctionParser joins runs of scalar terms like
+  "a&&b&&c" into a single function which evaluates all terms for the first
+  num_events events, then prints and uses the order expected to reject (for
+  "&&") or accept (for "||") events fastest. Affects only \link NamedFunc
+  NamedFuncs\endlink constructed afterwards, and is bypassed by Bytecode and
+  compiled functions.
+
+  \param[in] num_events Number of events to sample. 0 to keep the source order.
+*/
+void NamedFunc::AdaptiveLogic(long num_events){
+  adaptive_events = num_events;
+}
+
 /*!\brief Check if scalar function is valid
 
   \return True if scalar function is valid; false otherwise.
@@ -451,6 +993,27 @@ bool NamedFunc::IsVector() const{
   return static_cast<bool>(vector_func_);
 }
 
+/*!\brief Check if the function always returns the same scalar
+
+  True for \link NamedFunc NamedFuncs\endlink built from a number, including
+  expressions of numbers folded by FunctionParser, so that callers can skip
+  evaluating them for every event.
+
+  \return True if function is a known constant
+*/
+bool NamedFunc::IsConstant() const{
+  return is_constant_;
+}
+
+/*!\brief Get value of a constant function
+
+  \return Value returned by the function if NamedFunc::IsConstant(), 0
+  otherwise
+*/
+ScalarType NamedFunc::ConstantValue() const{
+  return constant_value_;
+}
+
 /*!\brief Evaluate scalar function with b as argument
 
   \param[in] b Baby to pass to scalar function
@@ -478,13 +1041,16 @@ VectorType NamedFunc::GetVector(const Baby &b) const{
   \return Reference to *this
 */
 NamedFunc & NamedFunc::operator += (const NamedFunc &func){
+  string key = CombineKeys(*this, "+", func);
+  BranchSet branches = CombineBranches(*this, func);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::plus, code_, func.code_);
   name_ = "("+name_ + ")+(" + func.name_ + ")";
   auto fp = ApplyOp(scalar_func_, vector_func_,
                     func.scalar_func_, func.vector_func_,
                     plus<ScalarType>());
   scalar_func_ = fp.first;
   vector_func_ = fp.second;
-  return *this;
+  return Key(key).Code(code).Branches(branches);
 }
 
 /*!\brief Subtract func from *this
@@ -494,13 +1060,16 @@ NamedFunc & NamedFunc::operator += (const NamedFunc &func){
   \return Reference to *this
 */
 NamedFunc & NamedFunc::operator -= (const NamedFunc &func){
+  string key = CombineKeys(*this, "-", func);
+  BranchSet branches = CombineBranches(*this, func);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::minus, code_, func.code_);
   name_ = "("+name_ + ")-(" + func.name_ + ")";
   auto fp = ApplyOp(scalar_func_, vector_func_,
                     func.scalar_func_, func.vector_func_,
                     minus<ScalarType>());
   scalar_func_ = fp.first;
   vector_func_ = fp.second;
-  return *this;
+  return Key(key).Code(code).Branches(branches);
 }
 
 /*!\brief Multiply *this by func
@@ -510,13 +1079,16 @@ NamedFunc & NamedFunc::operator -= (const NamedFunc &func){
   \return Reference to *this
 */
 NamedFunc & NamedFunc::operator *= (const NamedFunc &func){
+  string key = CombineKeys(*this, "*", func);
+  BranchSet branches = CombineBranches(*this, func);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::multiplies, code_, func.code_);
   name_ = "("+name_ + ")*(" + func.name_ + ")";
   auto fp = ApplyOp(scalar_func_, vector_func_,
                     func.scalar_func_, func.vector_func_,
                     multiplies<ScalarType>());
   scalar_func_ = fp.first;
   vector_func_ = fp.second;
-  return *this;
+  return Key(key).Code(code).Branches(branches);
 }
 
 /*!\brief Divide *this by func
@@ -526,13 +1098,16 @@ NamedFunc & NamedFunc::operator *= (const NamedFunc &func){
   \return Reference to *this
 */
 NamedFunc & NamedFunc::operator /= (const NamedFunc &func){
+  string key = CombineKeys(*this, "/", func);
+  BranchSet branches = CombineBranches(*this, func);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::divides, code_, func.code_);
   name_ = "("+name_ + ")/(" + func.name_ + ")";
   auto fp = ApplyOp(scalar_func_, vector_func_,
                     func.scalar_func_, func.vector_func_,
                     divides<ScalarType>());
   scalar_func_ = fp.first;
   vector_func_ = fp.second;
-  return *this;
+  return Key(key).Code(code).Branches(branches);
 }
 
 /*!\brief Set *this to remainder of *this divided by func
@@ -542,13 +1117,16 @@ NamedFunc & NamedFunc::operator /= (const NamedFunc &func){
   \return Reference to *this
 */
 NamedFunc & NamedFunc::operator %= (const NamedFunc &func){
+  string key = CombineKeys(*this, "%", func);
+  BranchSet branches = CombineBranches(*this, func);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::modulus, code_, func.code_);
   name_ = "("+name_ + ")%(" + func.name_ + ")";
   auto fp = ApplyOp(scalar_func_, vector_func_,
                     func.scalar_func_, func.vector_func_,
                     static_cast<ScalarType (*)(ScalarType ,ScalarType)>(fmod));
   scalar_func_ = fp.first;
   vector_func_ = fp.second;
-  return *this;
+  return Key(key).Code(code).Branches(branches);
 }
 
 /*!\brief Apply indexing operator and return result as a NamedFunc
@@ -558,9 +1136,13 @@ NamedFunc NamedFunc::operator [] (const NamedFunc &func) const{
   if(func.IsVector()) ERROR("Cannot use vector "+func.Name()+" as index");
   const auto &vec = VectorFunction();
   const auto &index = func.ScalarFunction();
-  return NamedFunc("("+Name()+")["+func.Name()+"]", [vec, index](const Baby &b){
+  NamedFunc result("("+Name()+")["+func.Name()+"]", [vec, index](const Baby &b){
       return vec(b).at(index(b));
     });
+  if(Key() != "" && func.Key() != "") result.Key("(" + Key() + ")[" + func.Key() + "]");
+  result.Code(Bytecode::Apply(Bytecode::Operator::subscript, Code(), func.Code()));
+  result.Branches(CombineBranches(*this, func));
+  return result;
 }
 
 /*!\brief Strip spaces from name
@@ -648,9 +1230,13 @@ NamedFunc operator + (NamedFunc f){
   \return NamedFunc returing the negative of the result of f
 */
 NamedFunc operator - (NamedFunc f){
+  string key = CombineKeys("-", f);
+  NamedFunc::BranchSet branches = f.Branches();
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::UnaryOperator::negate, f.Code());
   f.Name("-(" + f.Name() + ")");
   f.Function(ApplyOp(f.ScalarFunction(), negate<ScalarType>()));
   f.Function(ApplyOp(f.VectorFunction(), negate<ScalarType>()));
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -663,12 +1249,16 @@ NamedFunc operator - (NamedFunc f){
   \return NamedFunc returning whether the results of f and g are equal
 */
 NamedFunc operator == (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, "==", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::equal, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")==(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     equal_to<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -681,12 +1271,16 @@ NamedFunc operator == (NamedFunc f, NamedFunc g){
   \return NamedFunc returning whether the results of f and g are not equal
 */
 NamedFunc operator != (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, "!=", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::not_equal, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")!=(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     not_equal_to<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -700,12 +1294,16 @@ NamedFunc operator != (NamedFunc f, NamedFunc g){
   g
 */
 NamedFunc operator > (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, ">", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::greater, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")>(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     greater<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -718,12 +1316,16 @@ NamedFunc operator > (NamedFunc f, NamedFunc g){
   \return NamedFunc returning whether the results of f is less than result of g
 */
 NamedFunc operator < (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, "<", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::less, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")<(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     less<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -738,12 +1340,16 @@ NamedFunc operator < (NamedFunc f, NamedFunc g){
   to result of g
 */
 NamedFunc operator >= (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, ">=", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::greater_equal, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")>=(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     greater_equal<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -758,12 +1364,16 @@ NamedFunc operator >= (NamedFunc f, NamedFunc g){
   result of g
 */
 NamedFunc operator <= (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, "<=", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::less_equal, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")<=(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     less_equal<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -776,12 +1386,16 @@ NamedFunc operator <= (NamedFunc f, NamedFunc g){
   \return NamedFunc returning whether the results of both f and g are true
 */
 NamedFunc operator && (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, "&&", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::logical_and, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")&&(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     logical_and<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -794,12 +1408,16 @@ NamedFunc operator && (NamedFunc f, NamedFunc g){
   \return NamedFunc returning whether the results of f or g is true
 */
 NamedFunc operator || (NamedFunc f, NamedFunc g){
+  string key = CombineKeys(f, "||", g);
+  NamedFunc::BranchSet branches = CombineBranches(f, g);
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::Operator::logical_or, f.Code(), g.Code());
   f.Name("(" + f.Name() + ")||(" + g.Name() + ")");
   auto fp = ApplyOp(f.ScalarFunction(), f.VectorFunction(),
                     g.ScalarFunction(), g.VectorFunction(),
                     logical_or<ScalarType>());
   f.Function(fp.first);
   f.Function(fp.second);
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
@@ -810,12 +1428,40 @@ NamedFunc operator || (NamedFunc f, NamedFunc g){
   \return NamedFunc returning logical inverse of result of f
 */
 NamedFunc operator ! (NamedFunc f){
+  string key = CombineKeys("!", f);
+  NamedFunc::BranchSet branches = f.Branches();
+  Bytecode::Pointer code = Bytecode::Apply(Bytecode::UnaryOperator::logical_not, f.Code());
   f.Name("!(" + f.Name() + ")");
   f.Function(ApplyOp(f.ScalarFunction(), logical_not<ScalarType>()));
   f.Function(ApplyOp(f.VectorFunction(), logical_not<ScalarType>()));
+  f.Key(key).Code(code).Branches(branches);
   return f;
 }
 
+/*!\brief Gets NamedFunc returning whether all terms are true, evaluating them
+  in an order learned from the first events
+
+  \param[in] terms Scalar functions to combine
+
+  \return NamedFunc equivalent to terms[0]&&terms[1]&&... \see
+  NamedFunc::AdaptiveLogic()
+*/
+NamedFunc AdaptiveAnd(const vector<NamedFunc> &terms){
+  return MakeLogicChain(terms, true);
+}
+
+/*!\brief Gets NamedFunc returning whether any term is true, evaluating them in
+  an order learned from the first events
+
+  \param[in] terms Scalar functions to combine
+
+  \return NamedFunc equivalent to terms[0]||terms[1]||... \see
+  NamedFunc::AdaptiveLogic()
+*/
+NamedFunc AdaptiveOr(const vector<NamedFunc> &terms){
+  return MakeLogicChain(terms, false);
+}
+
 /*!\brief Print NamedFunc to output stream
 
   \param[in,out] stream Output stream to print to
@@ -11,11 +11,13 @@
 */
 #include "core/plot_maker.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <mutex>
 #include <chrono>
 #include <map>
 #include <iomanip>  // setw
+#include <iterator>
 
 #include "TLegend.h"
 
@@ -23,7 +25,10 @@
 #include "core/timer.hpp"
 #include "core/thread_pool.hpp"
 #include "core/named_func.hpp"
+#include "core/jit_function.hpp"
 #include "core/process.hpp"
+#include "core/column_cache.hpp"
+#include "core/entry_lists.hpp"
 
 using namespace std;
 using namespace PlotOptTypes;
@@ -37,6 +42,16 @@ using Clock = chrono::steady_clock;
 
 namespace{
   mutex print_mutex;
+
+  //!Number of ranges per thread queued ahead of the merge. Bounds the number
+  //!of unmerged shards, and so the memory used, independently of the number
+  //!of ranges.
+  constexpr size_t kRangesPerThread = 2;
+
+  long CountEntries(Baby *baby){
+    auto activator = baby->Activate();
+    return baby->GetEntries();
+  }
 }
 
 /*!\brief Standard constructor
@@ -44,6 +59,11 @@ namespace{
 PlotMaker::PlotMaker():
   multithreaded_(true),
   min_print_(true),
+  entries_per_range_(500000),
+  select_branches_(true),
+  cache_options_(),
+  column_cache_mb_(0.),
+  use_entry_lists_(false),
   figures_(){
 }
 
@@ -74,25 +94,122 @@ void PlotMaker::GetYields(){
   auto start_time = Clock::now();
 
   auto babies = GetBabies();
-  size_t num_threads = multithreaded_ ? min(babies.size(), static_cast<size_t>(thread::hardware_concurrency())) : 1;
-  cout << "Processing " << babies.size() << " babies with " << num_threads << " threads." << endl;
-
-  long num_entries = 0;
+  // Compiling holds the ROOT lock, so it is done before any event is processed
+  if(NamedFunc::UseJit()) JitFunction::CompileAll(babies);
+  size_t num_threads = multithreaded_ ? max(static_cast<size_t>(thread::hardware_concurrency()),
+                                            static_cast<size_t>(1)) : 1;
+  unique_ptr<ThreadPool> tp(num_threads > 1 ? new ThreadPool(num_threads) : nullptr);
 
-  if(multithreaded_ && num_threads>1){
-    vector<future<long> > num_entries_future(babies.size());
+  // Opening the files to count entries can be slow, so it is also done in parallel
+  vector<long> baby_entries(babies.size(), 0);
+  if(tp){
+    vector<future<long> > baby_entries_future(babies.size());
+    for(size_t ibaby = 0; ibaby < babies.size(); ++ibaby){
+      baby_entries_future.at(ibaby) = tp->Push(CountEntries, babies.at(ibaby));
+    }
+    for(size_t ibaby = 0; ibaby < babies.size(); ++ibaby){
+      baby_entries.at(ibaby) = baby_entries_future.at(ibaby).get();
+    }
+  }else{
+    for(size_t ibaby = 0; ibaby < babies.size(); ++ibaby){
+      baby_entries.at(ibaby) = CountEntries(babies.at(ibaby));
+    }
+  }
 
-    ThreadPool tp(num_threads);
-    size_t Nbabies = 0;
-    for(const auto &baby: babies){
-      num_entries_future.at(Nbabies) = tp.Push(bind(&PlotMaker::GetYield, this, ref(baby)));
-      ++Nbabies;
+  // Split each Baby into ranges of entries. The split does not depend on the
+  // number of threads, so results are reproducible from machine to machine
+  vector<EntryRange> ranges;
+  size_t num_all_branches = 0, num_listed = 0, num_recording = 0, num_filled_columns = 0;
+  long num_all_entries = 0, num_listed_entries = 0;
+  for(size_t ibaby = 0; ibaby < babies.size(); ++ibaby){
+    Baby *baby = babies.at(ibaby);
+    ProcFigs proc_figs;
+    for(const auto &proc: baby->processes_){
+      proc_figs.emplace_back(proc, GetComponents(proc));
+    }
+    NamedFunc::BranchSet branches = select_branches_ ? GetBranches(proc_figs) : nullptr;
+    if(!branches) ++num_all_branches;
+    long entries = baby_entries.at(ibaby);
+    if(column_cache_mb_ > 0. && branches) baby->CacheColumns(*branches, entries, column_cache_mb_);
+    num_all_entries += entries;
+    shared_ptr<const vector<long> > entry_list = nullptr;
+    vector<string> list_keys;
+    if(use_entry_lists_) entry_list = GetEntryList(*baby, proc_figs, list_keys);
+    if(entry_list){
+      entries = entry_list->size();
+      ++num_listed;
+    }else if(list_keys.size() != 0){
+      ++num_recording;
+    }
+    if(branches){
+      // Columns already held in memory for every entry to be read are served
+      // by the accessors, so their branches are neither enabled nor cached
+      set<string> filled = baby->FilledColumns(entry_list.get());
+      if(!filled.empty()){
+        auto read = make_shared<set<string> >();
+        set_difference(branches->cbegin(), branches->cend(), filled.cbegin(), filled.cend(),
+                       inserter(*read, read->end()));
+        num_filled_columns += branches->size() - read->size();
+        branches = read;
+      }
     }
+    num_listed_entries += entries;
+    long num_ranges = 1;
+    if(entries_per_range_ > 0) num_ranges = max((entries+entries_per_range_-1)/entries_per_range_, 1L);
+    for(long irange = 0; irange < num_ranges; ++irange){
+      ranges.push_back(EntryRange{baby, entries*irange/num_ranges, entries*(irange+1)/num_ranges,
+            entries, proc_figs, branches, entry_list, list_keys,
+            vector<vector<long> >(list_keys.size()), 0});
+    }
+  }
+  for(const auto &proc: GetProcesses()){
+    for(const auto &component: GetComponents(proc)){
+      component->ReserveShards(ranges.size());
+    }
+  }
+
+  if(tp) num_threads = min(num_threads, ranges.size());
+  cout << "Processing " << babies.size() << " babies in " << ranges.size()
+       << " entry ranges with " << num_threads << " threads." << endl;
+  if(select_branches_ && num_all_branches > 0){
+    cout << "Reading all branches for " << num_all_branches << " babies: some NamedFuncs do not"
+         << " declare their branches with NamedFunc::Branches()." << endl;
+  }
+  if(use_entry_lists_){
+    cout << "Loading " << AddCommas(num_listed_entries) << " of " << AddCommas(num_all_entries)
+         << " entries: entry lists found for " << num_listed << " babies, recorded for "
+         << num_recording << "." << endl;
+  }
+  if(column_cache_mb_ > 0.){
+    cout << "Keeping " << RoundNumber(ColumnCache::MegabytesUsed(), 1) << " of " << column_cache_mb_
+         << " MB of branch values in memory, " << num_filled_columns
+         << " branches served without reading the files." << endl;
+  }
+
+  long num_entries = 0;
+
+  if(tp){
+    vector<future<long> > num_entries_future(ranges.size());
+    size_t next_range = 0;
+    auto push_range = [&](){
+      num_entries_future.at(next_range) = tp->Push(bind(&PlotMaker::GetYield, this,
+                                                        ref(ranges.at(next_range)), next_range));
+      ++next_range;
+    };
+    while(next_range < min(ranges.size(), kRangesPerThread*num_threads)) push_range();
+    size_t Nbabies = babies.size();
     size_t Nfiles=0;
     long printStep=Nbabies/20+1; // Print up to 20 lines of info
     auto start_entries_time = Clock::now();
-    for(auto& entries: num_entries_future){
-      num_entries += entries.get();
+    // Partial results are merged in range order so that sums do not depend on
+    // which thread finished first. A new range is only queued once one is
+    // merged, so each component holds at most kRangesPerThread*num_threads
+    // shards at a time, however many ranges there are.
+    for(size_t irange = 0; irange < ranges.size(); ++irange){
+      num_entries += num_entries_future.at(irange).get();
+      MergeShards(ranges.at(irange), irange);
+      if(next_range < ranges.size()) push_range();
+      if(irange+1 < ranges.size() && ranges.at(irange+1).baby_ == ranges.at(irange).baby_) continue;
       Nfiles++;
       if(min_print_ && ((Nfiles-1)%printStep==0 || Nfiles==Nbabies)){
 	double seconds = chrono::duration<double>(Clock::now()-start_entries_time).count();
@@ -102,25 +219,44 @@ void PlotMaker::GetYields(){
       }
     }
   }else{
-    for(const auto &baby: babies){
-      num_entries += GetYield(ref(baby));
+    for(size_t irange = 0; irange < ranges.size(); ++irange){
+      num_entries += GetYield(ranges.at(irange), irange);
+      MergeShards(ranges.at(irange), irange);
     }
   }
+  if(num_recording > 0) WriteEntryLists(ranges);
+  long bytes_read = 0;
+  for(const auto &range: ranges) bytes_read += range.bytes_read_;
   auto end_time = Clock::now();
   double num_seconds = chrono::duration<double>(end_time-start_time).count();
   if(!min_print_) cout << endl << num_threads << " threads processed "
 		       << babies.size() << " babies with "
 		       << AddCommas(num_entries) << " events in "
 		       << num_seconds << " seconds = "
-		       << 0.001*num_entries/num_seconds << " kHz."
+		       << 0.001*num_entries/num_seconds << " kHz, reading "
+		       << RoundNumber(bytes_read, 1, 1<<20) << " MB from the ntuple files."
 		       << endl;
   cout << endl;
 }
 
-long PlotMaker::GetYield(Baby *baby_ptr){
+/*!\brief Loops over one range of entries, filling the per-range accumulators
+
+  The range is read through a private copy of the Baby, so that several ranges
+  of the same files can be processed at the same time.
+
+  \param[in] range Entries to process
+
+  \param[in] irange Index of the range, selecting the accumulators to fill
+
+  \return Number of entries processed
+*/
+long PlotMaker::GetYield(EntryRange &range, size_t irange){
   auto start_time = Clock::now();
+  unique_ptr<Baby> baby_ptr = range.baby_->Clone();
   Baby &baby = *baby_ptr;
+  if(!baby.GetCacheOptions()) baby.SetCacheOptions(cache_options_);
   auto activator = baby.Activate();
+  if(range.branches_) baby.EnableBranches(*range.branches_);
   string tag = "";
   if(baby.FileNames().size() == 1){
     tag = Basename(*baby.FileNames().cbegin());
@@ -133,58 +269,188 @@ long PlotMaker::GetYield(Baby *baby_ptr){
     if(proc != baby.processes_.cbegin()) oss << ", ";
     oss << (*proc)->name_;
   }
-  oss << "]" << flush;
+  oss << "]";
+  if(range.first_entry_ != 0 || range.end_entry_ != range.baby_entries_){
+    oss << " entries " << range.first_entry_ << "-" << range.end_entry_;
+  }
+  oss << flush;
   tag += oss.str();
 
-  long num_entries = baby.GetEntries();
-
-  vector<pair<const Process*, set<Figure::FigureComponent*> > > proc_figs(baby.processes_.size());
-  size_t iproc = 0;
-  for(const auto &proc: baby.processes_){
-    proc_figs.at(iproc).first = proc;
-    proc_figs.at(iproc).second = GetComponents(proc);
-    ++iproc;
-  }
+  long num_entries = range.end_entry_ - range.first_entry_;
 
+  // Each Process cut is evaluated once per event here and handed to the
+  // components, whose own cuts only contain the figure-specific selection
+  VectorType proc_cut_values;
   Timer timer(tag, num_entries, 10.);
-  for(long entry = 0; entry < num_entries; ++entry){
+  const vector<long> *entry_list = range.entry_list_.get();
+  bool recording = range.passing_entries_.size() != 0;
+  for(long ientry = range.first_entry_; ientry < range.end_entry_; ++ientry){
     if(!min_print_) timer.Iterate();
+    long entry = entry_list == nullptr ? ientry : (*entry_list)[ientry];
     baby.GetEntry(entry);
 
-    for(const auto &proc_fig: proc_figs){
-      if(proc_fig.first->cut_.IsScalar()){
-        if(!proc_fig.first->cut_.GetScalar(baby)) continue;
+    for(size_t iproc = 0; iproc < range.proc_figs_.size(); ++iproc){
+      const auto &proc_fig = range.proc_figs_[iproc];
+      const NamedFunc &proc_cut = proc_fig.first->cut_;
+      const VectorType *proc_cut_vector = nullptr;
+      if(proc_cut.IsConstant()){
+        if(!proc_cut.ConstantValue()) continue;
+      }else if(proc_cut.IsScalar()){
+        if(!proc_cut.GetScalar(baby)) continue;
       }else{
-        if(!HavePass(proc_fig.first->cut_.GetVector(baby))) continue;
+        proc_cut_values = proc_cut.GetVector(baby);
+        if(!HavePass(proc_cut_values)) continue;
+        proc_cut_vector = &proc_cut_values;
       }
+      if(recording) range.passing_entries_[iproc].push_back(entry);
       for(const auto &component: proc_fig.second){
-	lock_guard<mutex> lock(component->mutex_);
-        component->RecordEvent(baby);
+        component->RecordEvent(baby, proc_cut_vector, irange);
       }
     }
   }
 
   auto end_time = Clock::now();
   double num_seconds = chrono::duration<double>(end_time - start_time).count();
-  {
+  vector<Baby::ReadStats> read_stats = baby.GetReadStats();
+  for(const auto &stats: read_stats) range.bytes_read_ += stats.bytes_read_;
+  if(!min_print_){
     lock_guard<mutex> lock(print_mutex);
-    if(!min_print_) cout << setw(9) << num_entries << " entries/"
-                         << setw(10) << num_seconds << " sec.="
-                         << setw(10) << 0.001*num_entries/num_seconds << " kHz for " << tag << endl;
+    cout << setw(9) << num_entries << " entries/"
+         << setw(10) << num_seconds << " sec.="
+         << setw(10) << 0.001*num_entries/num_seconds << " kHz for " << tag << endl;
+    for(const auto &stats: read_stats){
+      cout << "          " << setw(8) << stats.read_calls_ << " read calls, "
+           << setw(9) << RoundNumber(stats.bytes_read_, 1, 1<<20) << " MB, cache efficiency ";
+      if(stats.cache_efficiency_ < 0.) cout << "  n/a";
+      else cout << setw(4) << RoundNumber(100.*stats.cache_efficiency_, 0) << "%";
+      cout << " for " << Basename(stats.file_name_) << endl;
+    }
   }
   return num_entries;
 }
 
-set<Baby*> PlotMaker::GetBabies() const{
-  set<Baby*> babies;
+/*!\brief Adds the accumulators filled for one range to their components
+
+  \param[in] range Range that has been fully processed
+
+  \param[in] irange Index of the range
+*/
+void PlotMaker::MergeShards(const EntryRange &range, size_t irange){
+  for(const auto &proc_fig: range.proc_figs_){
+    for(const auto &component: proc_fig.second){
+      component->MergeShard(irange);
+    }
+  }
+}
+
+/*!\brief Gets the entries of a Baby passing any of its Process cuts, as recorded
+  by earlier runs
+
+  \param[in] baby Baby to process
+
+  \param[in] proc_figs Processes using the Baby and the components they fill
+
+  \param[out] list_keys If some entry list is missing, the key under which the
+  list of each Process should be recorded, or an empty string for constant cuts.
+  Otherwise empty.
+
+  \return Sorted union of the entry lists, or null if all entries have to be
+  loaded, as when a Process cut has no NamedFunc::Key()
+*/
+shared_ptr<const vector<long> > PlotMaker::GetEntryList(const Baby &baby, const ProcFigs &proc_figs,
+                                                        vector<string> &list_keys) const{
+  list_keys.clear();
+  vector<string> keys;
+  vector<long> selected, entries, merged;
+  bool complete = true;
+  for(const auto &proc_fig: proc_figs){
+    const NamedFunc &cut = proc_fig.first->cut_;
+    if(cut.IsConstant()){
+      if(cut.ConstantValue()) return nullptr;
+      keys.push_back("");
+      continue;
+    }
+    // Names do not identify what custom functions compute, so only cuts with
+    // a canonical key can be recorded. The others need every entry.
+    if(cut.Key() == "") return nullptr;
+    keys.push_back(EntryLists::Key(baby.FileNames(), cut.Key()));
+    if(keys.back() == "") return nullptr;
+    if(!complete || !EntryLists::Read(keys.back(), entries)){
+      complete = false;
+      continue;
+    }
+    merged.clear();
+    set_union(selected.cbegin(), selected.cend(), entries.cbegin(), entries.cend(), back_inserter(merged));
+    selected.swap(merged);
+  }
+  if(!complete){
+    list_keys = keys;
+    return nullptr;
+  }
+  return make_shared<const vector<long> >(move(selected));
+}
+
+/*!\brief Writes the entry lists recorded while processing all ranges
+
+  \param[in] ranges Processed ranges, in entry order for each Baby
+*/
+void PlotMaker::WriteEntryLists(const vector<EntryRange> &ranges) const{
+  map<string, vector<long> > lists;
+  for(const auto &range: ranges){
+    for(size_t iproc = 0; iproc < range.list_keys_.size(); ++iproc){
+      const string &key = range.list_keys_.at(iproc);
+      if(key == "") continue;
+      const vector<long> &passing = range.passing_entries_.at(iproc);
+      vector<long> &list = lists[key];
+      list.insert(list.end(), passing.cbegin(), passing.cend());
+    }
+  }
+  for(const auto &list: lists){
+    EntryLists::Write(list.first, list.second);
+  }
+}
+
+/*!\brief Gets all Babies used by the figures
+
+  \return Babies sorted by file names, so that they are processed in the same
+  order on every run
+*/
+vector<Baby*> PlotMaker::GetBabies() const{
+  set<Baby*> baby_set;
   for(auto &proc: GetProcesses()){
     for(const auto &baby: proc->Babies()){
-      babies.insert(baby);
+      baby_set.insert(baby);
     }
   }
+  vector<Baby*> babies(baby_set.cbegin(), baby_set.cend());
+  stable_sort(babies.begin(), babies.end(),
+              [](const Baby *a, const Baby *b){return a->FileNames() < b->FileNames();});
   return babies;
 }
 
+/*!\brief Gets branches read by the process cuts and figure components
+
+  \param[in] proc_figs Processes using a Baby and the components they fill
+
+  \return Union of the branches of all functions, or null if any of them is
+  unknown
+*/
+NamedFunc::BranchSet PlotMaker::GetBranches(const ProcFigs &proc_figs) const{
+  auto branches = make_shared<set<string> >();
+  for(const auto &proc_fig: proc_figs){
+    vector<NamedFunc> funcs = {proc_fig.first->cut_};
+    for(const auto &component: proc_fig.second){
+      vector<NamedFunc> component_funcs = component->GetFunctions();
+      funcs.insert(funcs.end(), component_funcs.cbegin(), component_funcs.cend());
+    }
+    for(const auto &func: funcs){
+      if(!func.Branches()) return nullptr;
+      branches->insert(func.Branches()->cbegin(), func.Branches()->cend());
+    }
+  }
+  return branches;
+}
+
 set<const Process*> PlotMaker::GetProcesses() const{
   set<const Process*> processes;
   for(const auto &figure: figures_){
@@ -0,0 +1,330 @@
+/*! \class Skim
+
+  \brief Writes the events passing a cut to slimmed ntuples, one per Process
+
+  Each output file contains a tree with the name of the input tree, holding
+  the requested branches with their original types, plus computed columns
+  stored as Double_t (or vector<Double_t> for vector NamedFuncs). Files that
+  only keep the branches used downstream can then be read by the same Baby
+  class many times faster than the full ntuples.
+
+  Every entry range is written to its own temporary file by the thread that
+  processes it, so filling the trees needs no locking. Only creating and
+  closing the files holds Multithreading::root_mutex. The temporary files are
+  merged in range order by Print(), giving the same output for any number of
+  threads.
+*/
+#include "core/skim.hpp"
+
+#include <cstdio>
+
+#include <iostream>
+#include <mutex>
+
+#include "TChain.h"
+#include "TLeaf.h"
+#include "TSystem.h"
+
+#include "core/utilities.hpp"
+
+using namespace std;
+
+namespace{
+  /*!\brief Get the leaf type code of a copied branch
+
+    \param[in] type_name Type name of the input leaf
+
+    \return Code used in the TTree leaf list
+  */
+  char LeafCode(const string &type_name){
+    if(type_name == "Double_t") return 'D';
+    if(type_name == "Float_t") return 'F';
+    if(type_name == "Int_t") return 'I';
+    if(type_name == "Short_t") return 'S';
+    if(type_name == "UInt_t") return 'i';
+    if(type_name == "ULong64_t") return 'l';
+    if(type_name == "Bool_t") return 'O';
+    ERROR("Cannot skim branches of type "+type_name);
+    return 'D';
+  }
+}
+
+Skim::SingleSkim::SingleSkim(const Skim &skim,
+                             const shared_ptr<Process> &process):
+  FigureComponent(skim, process),
+  shards_(),
+  shard_paths_(),
+  tree_name_(){
+}
+
+/*!\brief Destructor. Removes temporary files that were never merged.
+*/
+Skim::SingleSkim::~SingleSkim(){
+  RemoveShards();
+  for(const auto &path: shard_paths_){
+    remove(path.c_str());
+  }
+}
+
+/*!\brief Get functions evaluated by RecordEvent()
+
+  \return Cut, copied branches, and computed columns
+*/
+vector<NamedFunc> Skim::SingleSkim::GetFunctions() const{
+  const Skim &skim = static_cast<const Skim&>(figure_);
+  vector<NamedFunc> funcs = {skim.cut_};
+  funcs.insert(funcs.end(), skim.branch_funcs_.cbegin(), skim.branch_funcs_.cend());
+  funcs.insert(funcs.end(), skim.columns_.cbegin(), skim.columns_.cend());
+  return funcs;
+}
+
+/*!\brief Makes room for the temporary file of each entry range
+
+  \param[in] num_shards Number of entry ranges that will be processed
+*/
+void Skim::SingleSkim::ReserveShards(size_t num_shards){
+  RemoveShards();
+  shards_.resize(num_shards);
+}
+
+void Skim::SingleSkim::RecordEvent(const Baby &baby,
+                                   const NamedFunc::VectorType *proc_cut_vector,
+                                   size_t ishard){
+  const Skim &skim = static_cast<const Skim&>(figure_);
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  // Created on the first entry, so that ranges without passing events still
+  // give the merged file its tree
+  if(!shard_ptr) shard_ptr.reset(new Shard(ShardPath(ishard), skim, baby));
+  Shard &shard = *shard_ptr;
+
+  bool is_vector = false;
+  if(!EvaluateCut(skim.cut_, baby, proc_cut_vector, shard.cut_vector_, is_vector)) return;
+  shard.Fill(skim, baby);
+}
+
+/*!\brief Closes the temporary file of an entry range
+
+  \param[in] ishard Index of the entry range to merge
+*/
+void Skim::SingleSkim::MergeShard(size_t ishard){
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) return;
+  Shard &shard = *shard_ptr;
+  tree_name_ = shard.tree_->GetName();
+  {
+    lock_guard<mutex> lock(Multithreading::root_mutex);
+    shard.file_->Write();
+    shard.file_->Close();
+  }
+  shard_paths_.push_back(shard.path_);
+  shard_ptr.reset();
+}
+
+/*!\brief Get path to the merged skim
+
+  \return Path to the output file
+*/
+string Skim::SingleSkim::OutputPath() const{
+  const Skim &skim = static_cast<const Skim&>(figure_);
+  return "skims/"+CodeToPlainText(skim.name_+"_SKIM_"+process_->name_)+".root";
+}
+
+/*!\brief Merges the temporary files of all processed ranges into the output
+  file, in range order
+
+  \return False if no event passed the Process cut, so no file was written
+*/
+bool Skim::SingleSkim::MergeFiles(){
+  if(shard_paths_.size() == 0) return false;
+  TChain chain(tree_name_.c_str());
+  for(const auto &path: shard_paths_){
+    chain.Add(path.c_str());
+  }
+  // Fast merging copies the compressed baskets without decoding them
+  chain.Merge(OutputPath().c_str(), "fast");
+  for(const auto &path: shard_paths_){
+    remove(path.c_str());
+  }
+  shard_paths_.clear();
+  return true;
+}
+
+/*!\brief Get path to the temporary file of an entry range
+
+  The process ID keeps concurrent jobs writing the same skim from sharing
+  temporary files.
+
+  \param[in] ishard Index of the entry range
+
+  \return Path to the temporary file
+*/
+string Skim::SingleSkim::ShardPath(size_t ishard) const{
+  const Skim &skim = static_cast<const Skim&>(figure_);
+  return "skims/"+CodeToPlainText(skim.name_+"_SKIM_"+process_->name_)
+    +"_pid"+to_string(gSystem->GetPid())+"_range"+to_string(ishard)+".root";
+}
+
+/*!\brief Closes and deletes the temporary files of ranges that were never
+  merged, e.g. after an exception in the event loop
+*/
+void Skim::SingleSkim::RemoveShards(){
+  for(auto &shard: shards_){
+    if(!shard) continue;
+    string path = shard->path_;
+    shard.reset();
+    remove(path.c_str());
+  }
+  shards_.clear();
+}
+
+/*!\brief Creates the temporary file and its tree
+
+  The types of the copied branches are taken from the tree currently loaded
+  by baby.
+
+  \param[in] path Path to the temporary file
+
+  \param[in] skim Skim being written
+
+  \param[in] baby Baby with the first event of the range loaded
+*/
+Skim::SingleSkim::Shard::Shard(const string &path, const Skim &skim, const Baby &baby):
+  path_(path),
+  file_(nullptr),
+  tree_(nullptr),
+  branch_values_(skim.branches_.size()),
+  scalar_values_(skim.columns_.size(), 0.),
+  vector_values_(skim.columns_.size()),
+  vector_addresses_(skim.columns_.size(), nullptr),
+  cut_vector_(){
+  lock_guard<mutex> lock(Multithreading::root_mutex);
+  file_.reset(new TFile(path.c_str(), "recreate"));
+  if(file_->IsZombie()) ERROR("Could not create "+path);
+  TChain *input = baby.GetTree().get();
+  tree_ = new TTree(input->GetName(), input->GetTitle());
+  tree_->SetDirectory(file_.get());
+
+  for(size_t ibranch = 0; ibranch < skim.branches_.size(); ++ibranch){
+    const string &name = skim.branches_.at(ibranch);
+    TBranch *branch = input->GetBranch(name.c_str());
+    if(branch == nullptr || branch->GetListOfLeaves()->GetEntries() == 0){
+      ERROR("Could not find branch "+name+" in "+input->GetName());
+    }
+    TLeaf *leaf = static_cast<TLeaf*>(branch->GetListOfLeaves()->At(0));
+    BranchValue &value = branch_values_.at(ibranch);
+    value.type_ = LeafCode(leaf->GetTypeName());
+    value.d_ = 0.;
+    tree_->Branch(name.c_str(), static_cast<void*>(&value.d_), (name+"/"+value.type_).c_str());
+  }
+
+  for(size_t icol = 0; icol < skim.columns_.size(); ++icol){
+    const NamedFunc &col = skim.columns_.at(icol);
+    string name = CodeToPlainText(col.Name());
+    if(col.IsScalar()){
+      tree_->Branch(name.c_str(), &scalar_values_.at(icol), (name+"/D").c_str());
+    }else{
+      vector_addresses_.at(icol) = &vector_values_.at(icol);
+      tree_->Branch(name.c_str(), &vector_addresses_.at(icol));
+    }
+  }
+}
+
+/*!\brief Destructor. Deletes the file and its tree holding the ROOT lock.
+*/
+Skim::SingleSkim::Shard::~Shard(){
+  lock_guard<mutex> lock(Multithreading::root_mutex);
+  file_.reset();
+}
+
+/*!\brief Writes the current event of baby to the tree
+
+  \param[in] skim Skim being written
+
+  \param[in] baby Baby with the event to write loaded
+*/
+void Skim::SingleSkim::Shard::Fill(const Skim &skim, const Baby &baby){
+  for(size_t ibranch = 0; ibranch < branch_values_.size(); ++ibranch){
+    BranchValue &value = branch_values_[ibranch];
+    // Baby variables are read as doubles, which hold all values of these
+    // types exactly except 64-bit integers above 2^53
+    NamedFunc::ScalarType x = skim.branch_funcs_[ibranch].GetScalar(baby);
+    switch(value.type_){
+    case 'D': value.d_ = x; break;
+    case 'F': value.f_ = static_cast<Float_t>(x); break;
+    case 'I': value.i_ = static_cast<Int_t>(x); break;
+    case 'S': value.s_ = static_cast<Short_t>(x); break;
+    case 'i': value.u_ = static_cast<UInt_t>(x); break;
+    case 'l': value.l_ = static_cast<ULong64_t>(x); break;
+    case 'O': value.o_ = x != 0.; break;
+    default: break;
+    }
+  }
+  for(size_t icol = 0; icol < skim.columns_.size(); ++icol){
+    const NamedFunc &col = skim.columns_[icol];
+    if(col.IsScalar()) scalar_values_[icol] = col.GetScalar(baby);
+    else vector_values_[icol] = col.GetVector(baby);
+  }
+  tree_->Fill();
+}
+
+/*!\brief Standard constructor
+
+  \param[in] name Name of the skim, used in the output file names
+
+  \param[in] cut Cut restricting written events, on top of the Process cut. An
+  event with per-object cut results is written if any object passes.
+
+  \param[in] branches Branches copied with their original types
+
+  \param[in] columns Computed columns, named after CodeToPlainText() of their
+  names
+
+  \param[in] processes Processes for which a skim is written
+*/
+Skim::Skim(const string &name,
+           const NamedFunc &cut,
+           const vector<string> &branches,
+           const vector<NamedFunc> &columns,
+           const vector<shared_ptr<Process> > &processes):
+  name_(name),
+  cut_(cut),
+  branches_(branches),
+  branch_funcs_(),
+  columns_(columns),
+  skims_(){
+  for(const auto &branch: branches_){
+    branch_funcs_.emplace_back(branch);
+    if(!branch_funcs_.back().IsScalar()) ERROR("Branch "+branch+" is not a scalar Baby variable");
+  }
+  gSystem->mkdir("skims", true);
+  for(const auto& proc: processes){
+    skims_.emplace_back(new SingleSkim(*this, proc));
+  }
+}
+
+void Skim::Print(double /*luminosity*/,
+                 const std::string & /*subdir*/){
+  for(const auto &skim: skims_){
+    if(skim->MergeFiles()){
+      cout << " root -l " << skim->OutputPath() << endl;
+    }else{
+      cout << " No events passed the cut of " << skim->process_->name_ << ", did not write "
+           << skim->OutputPath() << endl;
+    }
+  }
+}
+
+set<const Process*> Skim::GetProcesses() const{
+  set<const Process *> processes;
+  for(const auto &skim: skims_){
+    processes.insert(skim->process_.get());
+  }
+  return processes;
+}
+
+Figure::FigureComponent * Skim::GetComponent(const Process *process){
+  for(const auto &skim: skims_){
+    if(skim->process_.get() == process) return skim.get();
+  }
+  return nullptr;
+}
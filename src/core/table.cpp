@@ -1,7 +1,11 @@
 #include "core/table.hpp"
 
+#include <cctype>
+
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
+#include <stdexcept>
 
 #include <sys/stat.h>
 
@@ -35,6 +39,79 @@ namespace{
     }
     return x;
   }
+
+  //!Term of the top-level "&&" chain of a cut: its key and the Bytecode evaluating it
+  using CutTerm = pair<string, Bytecode::Pointer>;
+
+  /*!\brief Get position of the top-level "&&" in a key
+
+    Keys of binary operations have the form "(a)op(b)", so the operator
+    follows the parenthesis closing the first one.
+
+    \param[in] key Canonical key of a function
+
+    \return Position of the "&&", or string::npos if key is not a "&&" of two
+    keys
+  */
+  size_t TopLevelAnd(const string &key){
+    if(key.size() < 6 || key.front() != '(' || key.back() != ')') return string::npos;
+    int depth = 0;
+    for(size_t i = 0; i < key.size(); ++i){
+      if(key[i] == '('){
+        ++depth;
+      }else if(key[i] == ')' && --depth == 0){
+        if(key.compare(i+1, 3, "&&(") == 0) return i+1;
+        return string::npos;
+      }
+    }
+    return string::npos;
+  }
+
+  /*!\brief Splits a cut into the terms of its top-level "&&" chain
+
+    The key of "a&&b" is "(key of a)&&(key of b)" and its Bytecode applies
+    logical_and to the Bytecode of a and b, whether it was parsed from a string
+    or built with NamedFunc's operator&&. Both are split in step, so terms are
+    found from the structure of the function and not from its name.
+
+    \param[in] key Key of the cut or of one of its terms
+
+    \param[in] code Bytecode of the same expression as key
+
+    \param[out] terms Terms appended in source order, excluding the constant 1
+  */
+  void CutTerms(const string &key, const Bytecode::Pointer &code, vector<CutTerm> &terms){
+    if(key == "#1") return;
+    // Chains reordered by NamedFunc::AdaptiveLogic() have the Bytecode of the
+    // plain chain and its key behind a prefix
+    if(StartsWith(key, "adaptive:")){
+      CutTerms(key.substr(9), code, terms);
+      return;
+    }
+    size_t split = TopLevelAnd(key);
+    if(split == string::npos || !code || !code->Applies(Bytecode::Operator::logical_and)){
+      terms.emplace_back(key, code);
+      return;
+    }
+    CutTerms(key.substr(1, split-2), code->LeftOperand(), terms);
+    CutTerms(key.substr(split+3, key.size()-split-4), code->RightOperand(), terms);
+  }
+
+  /*!\brief Get function evaluating a term found by CutTerms()
+
+    \param[in] term Key and Bytecode of the term
+
+    \return Function sharing the registered implementation and cached result
+    of term's key
+  */
+  NamedFunc TermFunction(const CutTerm &term){
+    const Bytecode::Pointer &code = term.second;
+    NamedFunc func = code->IsScalar()
+      ? NamedFunc(term.first, function<NamedFunc::ScalarFunc>([code](const Baby &b){return code->GetScalar(b);}))
+      : NamedFunc(term.first, function<NamedFunc::VectorFunc>([code](const Baby &b){return code->GetVector(b);}));
+    func.Key(term.first).Code(code);
+    return func;
+  }
 }
 
 Table::TableColumn::TableColumn(const Table &table, const shared_ptr<Process> &process,
@@ -42,64 +119,187 @@ Table::TableColumn::TableColumn(const Table &table, const shared_ptr<Process> &p
   FigureComponent(table, process),
   sumw_(table.rows_.size(), 0.),
   sumw2_(table.rows_.size(), 0.),
-  proc_and_table_cut_(cuts.size(), process->cut_),
-  cut_vector_(),
-  wgt_vector_(),
-  val_vector_(){
+  table_cut_(cuts),
+  increment_cut_(),
+  implies_previous_(),
+  is_incremental_(),
+  shards_(){
+}
+
+/*!\brief Get functions evaluated by RecordEvent()
+
+  \return Cut and weight of every data row
+*/
+vector<NamedFunc> Table::TableColumn::GetFunctions() const{
+  const Table& table = static_cast<const Table&>(figure_);
+  vector<NamedFunc> funcs;
   for(size_t irow = 0; irow < table.rows_.size(); ++irow){
-    proc_and_table_cut_.at(irow) = cuts[irow] && process->cut_;
+    const TableRow& row = table.rows_.at(irow);
+    if(!row.is_data_row_) continue;
+    funcs.push_back(table_cut_.at(irow));
+    funcs.push_back(row.weight_);
   }
+  return funcs;
+}
+
+/*!\brief Makes room for one set of partial yields per entry range
+
+  \param[in] num_shards Number of entry ranges that will be processed
+*/
+void Table::TableColumn::ReserveShards(size_t num_shards){
+  shards_.clear();
+  shards_.resize(num_shards);
+  FindNestedRows();
 }
 
-void Table::TableColumn::RecordEvent(const Baby &baby){
+void Table::TableColumn::RecordEvent(const Baby &baby,
+                                     const NamedFunc::VectorType *proc_cut_vector,
+                                     size_t ishard){
   const Table& table = static_cast<const Table&>(figure_);
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) shard_ptr.reset(new Shard(table.rows_.size()));
+  Shard &shard = *shard_ptr;
 
   bool have_vector;
   size_t min_vec_size;
+  bool prev_pass = true;
+  const NamedFunc::VectorType *prev_cut_vector = proc_cut_vector;
   for(size_t irow = 0; irow < table.rows_.size(); ++irow){
     have_vector = false;
     min_vec_size = 0;
 
     const TableRow& row = table.rows_.at(irow);
     if(!row.is_data_row_) continue;
-    const NamedFunc &cut = proc_and_table_cut_.at(irow);
     const NamedFunc &wgt = row.weight_;
 
-    if(cut.IsScalar()){
-      if(!cut.GetScalar(baby)) continue;
-      
+    // In a cutflow, rows after the first failing one are skipped, and rows
+    // extending the previous one only evaluate the added condition
+    bool cut_is_vector = false;
+    if(implies_previous_.at(irow) && !prev_pass) continue;
+    if(is_incremental_.at(irow)){
+      prev_pass = EvaluateCut(increment_cut_.at(irow), baby, prev_cut_vector, shard.cut_vector_, cut_is_vector);
     }else{
-      cut_vector_ = cut.GetVector(baby);
-      if(!have_vector || cut_vector_.size() < min_vec_size){
-       have_vector = true;
-       min_vec_size = cut_vector_.size();
-      }
+      prev_pass = EvaluateCut(table_cut_.at(irow), baby, proc_cut_vector, shard.cut_vector_, cut_is_vector);
+    }
+    if(!prev_pass) continue;
+    if(cut_is_vector){
+      have_vector = true;
+      min_vec_size = shard.cut_vector_.size();
     }
 
     NamedFunc::ScalarType wgt_scalar = 0.;
     if(wgt.IsScalar()){
-      wgt_scalar = wgt.GetScalar(baby);
+      wgt_scalar = wgt.IsConstant() ? wgt.ConstantValue() : wgt.GetScalar(baby);
     }else{
-      wgt_vector_ = wgt.GetVector(baby);
-      if(!have_vector || wgt_vector_.size() < min_vec_size){
+      shard.wgt_vector_ = wgt.GetVector(baby);
+      if(!have_vector || shard.wgt_vector_.size() < min_vec_size){
        have_vector = true;
-       min_vec_size = wgt_vector_.size();
+       min_vec_size = shard.wgt_vector_.size();
       }
     }
 
     if(!have_vector){
-      sumw_.at(irow) += wgt_scalar;
-      sumw2_.at(irow) += wgt_scalar*wgt_scalar;
+      shard.sumw_.at(irow) += wgt_scalar;
+      shard.sumw2_.at(irow) += wgt_scalar*wgt_scalar;
     }else{
       for(size_t iobject = 0; iobject < min_vec_size; ++iobject){
-       NamedFunc::ScalarType this_cut = cut.IsScalar() ? true : cut_vector_.at(iobject);
+       NamedFunc::ScalarType this_cut = cut_is_vector ? shard.cut_vector_.at(iobject) : true;
        if(!this_cut) continue;
-       NamedFunc::ScalarType this_wgt = wgt.IsScalar() ? wgt_scalar : wgt_vector_.at(iobject);
-       sumw_.at(irow) += this_wgt;
-       sumw2_.at(irow) += this_wgt*this_wgt;
+       NamedFunc::ScalarType this_wgt = wgt.IsScalar() ? wgt_scalar : shard.wgt_vector_.at(iobject);
+       shard.sumw_.at(irow) += this_wgt;
+       shard.sumw2_.at(irow) += this_wgt*this_wgt;
+      }
+    }
+
+    if(cut_is_vector){
+      shard.prev_cut_vector_.swap(shard.cut_vector_);
+      prev_cut_vector = &shard.prev_cut_vector_;
+    }else{
+      prev_cut_vector = nullptr;
+    }
+  }
+}
+
+/*!\brief Finds the data rows whose cut implies the cut of the previous data
+  row
+
+  A row implies the previous data row if its cut contains all the terms of the
+  previous "&&" chain, or if the table is declared a cutflow with
+  Table::Cutflow(). In the first case, the remaining terms form the condition
+  added by the row, evaluated on top of the result of the previous row. Terms
+  are compared by NamedFunc::Key(), so rows whose cut has no key, like custom
+  functions, are always evaluated in full.
+*/
+void Table::TableColumn::FindNestedRows(){
+  const Table& table = static_cast<const Table&>(figure_);
+  size_t num_rows = table.rows_.size();
+  increment_cut_.assign(num_rows, NamedFunc(1.));
+  implies_previous_.assign(num_rows, false);
+  is_incremental_.assign(num_rows, false);
+
+  bool have_prev = false, prev_has_key = false;
+  vector<CutTerm> prev_terms;
+  for(size_t irow = 0; irow < num_rows; ++irow){
+    if(!table.rows_.at(irow).is_data_row_) continue;
+    const NamedFunc &cut = table_cut_.at(irow);
+    bool has_key = cut.Key() != "";
+    vector<CutTerm> terms;
+    if(has_key) CutTerms(cut.Key(), cut.Code(), terms);
+    bool contains_prev = have_prev && has_key && prev_has_key;
+    vector<CutTerm> extra = terms;
+    if(contains_prev){
+      for(const auto &term: prev_terms){
+        auto found = find_if(extra.begin(), extra.end(),
+                             [&term](const CutTerm &t){return t.first == term.first;});
+        if(found == extra.end()){
+          contains_prev = false;
+          break;
+        }
+        extra.erase(found);
+      }
+    }
+    if(have_prev) implies_previous_.at(irow) = contains_prev || table.cutflow_;
+    bool have_code = all_of(extra.cbegin(), extra.cend(),
+                            [](const CutTerm &t){return static_cast<bool>(t.second);});
+    if(contains_prev && have_code){
+      NamedFunc increment(1.);
+      for(size_t iterm = 0; iterm < extra.size(); ++iterm){
+        NamedFunc term = TermFunction(extra.at(iterm));
+        increment = iterm == 0 ? term : increment && term;
       }
+      increment_cut_.at(irow) = increment;
+      is_incremental_.at(irow) = true;
     }
+    prev_terms = terms;
+    prev_has_key = has_key;
+    have_prev = true;
+  }
+}
+
+/*!\brief Adds the partial yields of an entry range to sumw_ and sumw2_
+
+  \param[in] ishard Index of the entry range to merge
+*/
+void Table::TableColumn::MergeShard(size_t ishard){
+  unique_ptr<Shard> &shard_ptr = shards_.at(ishard);
+  if(!shard_ptr) return;
+  for(size_t irow = 0; irow < sumw_.size(); ++irow){
+    sumw_.at(irow) += shard_ptr->sumw_.at(irow);
+    sumw2_.at(irow) += shard_ptr->sumw2_.at(irow);
   }
+  shard_ptr.reset();
+}
+
+/*!\brief Standard constructor
+
+  \param[in] num_rows Number of rows in the table
+*/
+Table::TableColumn::Shard::Shard(size_t num_rows):
+  sumw_(num_rows, 0.),
+  sumw2_(num_rows, 0.),
+  cut_vector_(),
+  wgt_vector_(),
+  prev_cut_vector_(){
 }
 
 Table::Table(const string &name,
@@ -125,6 +325,7 @@ Table::Table(const string &name,
   tot_factor_(1.),
   precision_(0),
   plot_options_({PlotOpt("txt/plot_styles.txt", "Pie")}),
+  cutflow_(false),
   backgrounds_(),
   signals_(),
   datas_(){
@@ -506,3 +707,16 @@ Table & Table::Precision(const double &precision){
   precision_ = precision;
   return *this;
 }
+
+/*!\brief Declares that each data row selects a subset of the previous one
+
+  Rows are then skipped once an event fails a row, even if their cuts do not
+  visibly contain the cut of the previous row. Nested rows whose cut repeats
+  the previous "&&" chain are detected without this setting.
+
+  \param[in] cutflow Whether the rows form a cutflow
+*/
+Table & Table::Cutflow(bool cutflow){
+  cutflow_ = cutflow;
+  return *this;
+}
@@ -1,6 +1,6 @@
 #include "core/thread_pool.hpp"
 
-#include "TThread.h"
+#include "TROOT.h"
 
 using namespace std;
 
@@ -11,7 +11,7 @@ ThreadPool::ThreadPool():
   stop_at_empty_(),
   mutex_(),
   cv_(){
-  TThread::Initialize();
+  ROOT::EnableThreadSafety();
   size_t num_threads = thread::hardware_concurrency();
   if(num_threads > 2){
     --num_threads;
@@ -28,7 +28,7 @@ ThreadPool::ThreadPool(std::size_t num_threads):
   stop_at_empty_(),
   mutex_(),
   cv_(){
-  TThread::Initialize();
+  ROOT::EnableThreadSafety();
   Resize(num_threads);
 }
 
@@ -79,11 +79,84 @@ string Strip(string s){
   return LeftStrip(RightStrip(s));
 }
 
+/*!\brief Get Levenshtein distance between two strings
+
+  \param[in] a First string
+
+  \param[in] b Second string
+
+  \return Minimum number of single character insertions, deletions, and
+  substitutions turning a into b
+*/
+size_t EditDistance(const string &a, const string &b){
+  vector<size_t> row(b.size()+1);
+  iota(row.begin(), row.end(), 0);
+  for(size_t i = 0; i < a.size(); ++i){
+    size_t diagonal = row.at(0);
+    row.at(0) = i+1;
+    for(size_t j = 0; j < b.size(); ++j){
+      size_t above = row.at(j+1);
+      row.at(j+1) = min({above+1, row.at(j)+1, diagonal+(a.at(i) == b.at(j) ? 0 : 1)});
+      diagonal = above;
+    }
+  }
+  return row.back();
+}
+
+/*!\brief Get 64-bit FNV-1a hash of a string
+
+  \param[in] text String to hash
+
+  \return Hash as 16 hexadecimal digits
+*/
+string HashString(const string &text){
+  uint64_t hash = 0xcbf29ce484222325;
+  for(const auto &c: text){
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3;
+  }
+  ostringstream oss;
+  oss << hex << setfill('0') << setw(16) << hash;
+  return oss.str();
+}
+
 bool FileExists(const string &path){
   struct stat buffer;
   return (stat (path.c_str(), &buffer) == 0);
 }
 
+/*!\brief Get absolute path of a file, with symbolic links resolved
+
+  \param[in] path Path to resolve
+
+  \return Canonical path, or path itself if it does not exist
+*/
+string CanonicalPath(const string &path){
+  char *resolved = realpath(path.c_str(), nullptr);
+  if(resolved == nullptr) return path;
+  string canonical = resolved;
+  free(resolved);
+  return canonical;
+}
+
+/*!\brief Get size and modification time of a file
+
+  \param[in] path File to check
+
+  \param[out] size Size in bytes
+
+  \param[out] mtime Modification time in seconds since the epoch
+
+  \return False if the file does not exist
+*/
+bool FileStatus(const string &path, long &size, long &mtime){
+  struct stat buffer;
+  if(stat(path.c_str(), &buffer) != 0) return false;
+  size = buffer.st_size;
+  mtime = buffer.st_mtime;
+  return true;
+}
+
 string execute(const string &cmd){
   FILE *pipe = popen(cmd.c_str(), "r");
   if(!pipe) throw runtime_error("Could not open pipe.");
@@ -25,6 +25,7 @@ using namespace PlotOptTypes;
 
 int main(){
   gErrorIgnoreLevel=6000; // Turns off ROOT errors due to missing branches
+  NamedFunc::UseJit(true); // Compiles the cut strings, cached in bin/jit for later runs
 
   time_t begtime, endtime;
   time(&begtime);
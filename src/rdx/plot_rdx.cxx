@@ -73,10 +73,12 @@ int main(){
   NamedFunc logbpt("logbpt", [&](const Baby &b){
     return log(b.b_pt()*1000);
   });
+  logbpt.Branches({"b_pt"});
   NamedFunc woverjk("woverjk", [&](const Baby &b){
     if(b.wjk() != 0) return b.wiso()/b.wjk();
     else return 0.;
   });
+  woverjk.Branches({"wiso", "wjk"});
 
   string basew = "wskim_iso*skim_global_ok*wff*wtrg*wtrk*wbr_dd*w_missDDX";
   vector<NamedFunc> weights({"1", basew+"*wjk*wpid_ubdt", basew + "*wpid_ubdt", basew + "*wjk"});